@@ -73,3 +73,41 @@ statPrint(const stat_t * s)
 {
   printf("Statistics: count = %u, total time = %lu.%09lu\n", s->count, s->total_time.tv_sec, s->total_time.tv_nsec);
 }
+
+double
+clockNow(void)
+{
+  struct timespec tsnow;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &tsnow) != 0)
+    return 0.0;
+  return tsnow.tv_sec + tsnow.tv_nsec / (double) BILLION;
+}
+
+void
+latReset(lat_t * l)
+{
+  l->count = 0;
+  l->total = 0.0;
+  l->min = 0.0;
+  l->max = 0.0;
+}
+
+void
+latAdd(lat_t * l, double seconds)
+{
+  if (l->count == 0 || seconds < l->min)
+    l->min = seconds;
+  if (l->count == 0 || seconds > l->max)
+    l->max = seconds;
+  l->total += seconds;
+  l->count++;
+}
+
+void
+latPrint(const lat_t * l, const char * name)
+{
+  printf("Latency %s: count = %u, mean = %.6f, min = %.6f, max = %.6f\n",
+         name, l->count, l->count ? l->total / l->count : 0.0,
+         l->min, l->max);
+}
@@ -25,6 +25,27 @@ statStop(stat_t * s);
 void
 statPrint(const stat_t * s);
 
+/* Wall-clock latency samples (seconds), e.g. from sensor data to command. */
+typedef struct lat {
+  unsigned int count;
+  double total;
+  double min;
+  double max;
+} lat_t;
+
+/* Monotonic wall-clock time in seconds. */
+double
+clockNow(void);
+
+void
+latReset(lat_t * l);
+
+void
+latAdd(lat_t * l, double seconds);
+
+void
+latPrint(const lat_t * l, const char * name);
+
 #ifdef __cplusplus /* If this is a C++ compiler, end C linkage */
 }
 #endif
@@ -0,0 +1,376 @@
+/*
+ *  Headless comparison of the two ND implementations of the tree: the
+ *  Minguez ND of nd/cpp (IterarND) and the openrobots nddLib
+ *  (nddComputeRefFromPoints).  Both are fed the same recorded laser scans
+ *  and the cost of each cycle (wall-clock time and heap allocations) is
+ *  reported as "key value" lines.
+ *
+ *  Usage: nd_compare [-f scans] [-w scans] [-r repetitions]
+ *
+ *    -f  read the scans from a file instead of using the built-in run
+ *    -w  write the scans used to a file (to record the built-in run)
+ *    -r  number of passes over the scans (default 20)
+ *
+ *  Scan files hold one scan per line, in the odometric frame:
+ *
+ *    x y a goal_x goal_y min_angle resolution n range_0 ... range_n-1
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nd.h"
+extern "C" {
+#include "nddLib.h"
+}
+#include "clock.h"
+
+#define MAX_SCANS 2000
+#define MAX_BEAMS 1081
+
+typedef struct {
+  double x, y, a;           // robot pose
+  double gx, gy;            // goal
+  double min_angle, resolution;
+  int n;
+  float ranges[MAX_BEAMS];
+} scan_t;
+
+static scan_t scans[MAX_SCANS];
+static int num_scans;
+
+// ----------------------------------------------------------------------------
+// Allocation counting (glibc only)
+// ----------------------------------------------------------------------------
+
+static unsigned long allocations;
+
+#if defined(__GLIBC__)
+#define COUNT_ALLOCATIONS 1
+extern "C" {
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) { allocations++; return __libc_malloc(size); }
+void *calloc(size_t n, size_t size) { allocations++; return __libc_calloc(n, size); }
+void *realloc(void *p, size_t size) { allocations++; return __libc_realloc(p, size); }
+}
+#else
+#define COUNT_ALLOCATIONS 0
+#endif
+
+// ----------------------------------------------------------------------------
+// Built-in run: a simulated 181 beam laser driving down a cluttered
+// corridor and through a door
+// ----------------------------------------------------------------------------
+
+static const double walls[][4] = {
+  { -1.0, -1.2, 8.0, -1.2 },   // corridor
+  { -1.0,  1.2, 5.0,  1.2 },
+  {  5.8,  1.2, 8.0,  1.2 },   // door between x=5 and x=5.8
+  {  5.0,  1.2, 5.0,  4.0 },   // room behind the door
+  {  5.8,  1.2, 5.8,  4.0 },
+  {  8.0, -1.2, 8.0,  1.2 },
+  {  2.0, -1.2, 2.3, -0.7 },   // boxes
+  {  2.3, -0.7, 2.6, -1.2 },
+  {  3.5,  1.2, 3.8,  0.6 },
+  {  3.8,  0.6, 4.1,  1.2 },
+};
+
+static double RayCast(double x, double y, double a)
+{
+  double dx = cos(a), dy = sin(a), best = 8.0;
+  unsigned int i;
+
+  for(i=0;i<sizeof(walls)/sizeof(walls[0]);i++)
+  {
+    double ex = walls[i][2] - walls[i][0], ey = walls[i][3] - walls[i][1];
+    double den = dx * ey - dy * ex;
+    if(fabs(den) < 1e-12)
+      continue;
+    double wx = walls[i][0] - x, wy = walls[i][1] - y;
+    double t = (wx * ey - wy * ex) / den;
+    double u = (wx * dy - wy * dx) / den;
+    if(t > 0.0 && u >= 0.0 && u <= 1.0 && t < best)
+      best = t;
+  }
+  return best;
+}
+
+static void BuiltInScans(void)
+{
+  int i, k;
+
+  num_scans = 0;
+  for(i=0;i<300;i++)
+  {
+    scan_t *s = &scans[num_scans++];
+    double t = i / 299.0;
+
+    // Down the corridor, then turn into the door
+    if(t < 0.7)
+    {
+      s->x = -0.5 + 5.9 * t / 0.7;
+      s->y = 0.2 * sin(6.0 * t);
+      s->a = 0.0;
+    }
+    else
+    {
+      s->x = 5.4;
+      s->y = 2.5 * (t - 0.7) / 0.3;
+      s->a = M_PI / 2 * (t - 0.7) / 0.3;
+    }
+    s->gx = 5.4;
+    s->gy = 3.5;
+    s->min_angle = -M_PI / 2;
+    s->resolution = M_PI / 180;
+    s->n = 181;
+    for(k=0;k<s->n;k++)
+      s->ranges[k] = (float)RayCast(s->x, s->y,
+                                    s->a + s->min_angle + k * s->resolution);
+  }
+}
+
+static int ReadScans(const char *name)
+{
+  FILE *f = fopen(name, "r");
+  int k;
+
+  if(!f)
+    return -1;
+  num_scans = 0;
+  while(num_scans < MAX_SCANS)
+  {
+    scan_t *s = &scans[num_scans];
+    if(fscanf(f, "%lf %lf %lf %lf %lf %lf %lf %d", &s->x, &s->y, &s->a,
+              &s->gx, &s->gy, &s->min_angle, &s->resolution, &s->n) != 8)
+      break;
+    if(s->n < 0 || s->n > MAX_BEAMS)
+      break;
+    for(k=0;k<s->n;k++)
+      if(fscanf(f, "%f", &s->ranges[k]) != 1)
+        break;
+    if(k < s->n)
+      break;
+    num_scans++;
+  }
+  fclose(f);
+  return num_scans > 0 ? 0 : -1;
+}
+
+static int WriteScans(const char *name)
+{
+  FILE *f = fopen(name, "w");
+  int i, k;
+
+  if(!f)
+    return -1;
+  for(i=0;i<num_scans;i++)
+  {
+    const scan_t *s = &scans[i];
+    fprintf(f, "%.6f %.6f %.6f %.6f %.6f %.6f %.9f %d", s->x, s->y, s->a,
+            s->gx, s->gy, s->min_angle, s->resolution, s->n);
+    for(k=0;k<s->n;k++)
+      fprintf(f, " %.4f", s->ranges[k]);
+    fprintf(f, "\n");
+  }
+  fclose(f);
+  return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Statistics
+// ----------------------------------------------------------------------------
+
+typedef struct {
+  const char *name;
+  double *times;
+  int count;
+  unsigned long allocations;
+  int stops;
+} result_t;
+
+static int CompareDoubles(const void *a, const void *b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static void PrintResult(result_t *r)
+{
+  double total = 0.0;
+  int i;
+
+  qsort(r->times, r->count, sizeof(double), CompareDoubles);
+  for(i=0;i<r->count;i++)
+    total += r->times[i];
+
+  printf("%s_cycles %d\n", r->name, r->count);
+  printf("%s_mean_us %.3f\n", r->name, 1e6 * total / r->count);
+  printf("%s_p50_us %.3f\n", r->name, 1e6 * r->times[r->count / 2]);
+  printf("%s_p99_us %.3f\n", r->name, 1e6 * r->times[(r->count * 99) / 100]);
+  printf("%s_max_us %.3f\n", r->name, 1e6 * r->times[r->count - 1]);
+  if(COUNT_ALLOCATIONS)
+    printf("%s_allocations_per_cycle %.3f\n", r->name,
+           (double)r->allocations / r->count);
+  printf("%s_no_motion %d\n", r->name, r->stops);
+}
+
+// ----------------------------------------------------------------------------
+
+static TInfoEntorno mapa;
+static NDD_POINT points[MAX_BEAMS];
+
+int main(int argc, char **argv)
+{
+  const char *input = NULL, *output = NULL;
+  int repetitions = 20;
+  int opt, rep, i, k;
+
+  while((opt = getopt(argc, argv, "f:w:r:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'f': input = optarg; break;
+      case 'w': output = optarg; break;
+      case 'r': repetitions = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-f scans] [-w scans] [-r repetitions]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if(repetitions < 1)
+    repetitions = 1;
+
+  if(input)
+  {
+    if(ReadScans(input) != 0)
+    {
+      fprintf(stderr, "unable to read scans from %s\n", input);
+      return 1;
+    }
+  }
+  else
+    BuiltInScans();
+  if(output && WriteScans(output) != 0)
+  {
+    fprintf(stderr, "unable to write scans to %s\n", output);
+    return 1;
+  }
+
+  // The same 0.5 x 0.4 m robot for both
+  TParametersND p;
+  memset(&p, 0, sizeof(p));
+  p.geometryRect = 1;
+  p.front = 0.3F; p.back = 0.2F; p.left = 0.2F;
+  p.R = 0.2F;
+  p.vlmax = 0.5F; p.vamax = 1.0F;
+  p.almax = 0.75F; p.aamax = 0.75F;
+  p.dsmax = 0.5F; p.dsmin = 0.125F; p.enlarge = 0.025F;
+  p.discontinuity = 0.4F;
+  p.T = 0.1F;
+  InicializarND(&p);
+
+  NDD_CONTEXT ctx;
+  double lmax = hypot(0.5, 0.4);
+  nddContextInit(&ctx, NDD_DMAX_SICK, (float)lmax, 0.5,
+                 NDD_DEFAULT_DMAXLOCALMAP, NDD_DEFAULT_SMAX, 0.5, 1.0,
+                 NDD_DEFAULT_LIN_FACTOR, 0.1F);
+
+  result_t nd = { "nd", NULL, 0, 0, 0 };
+  result_t ndd = { "ndd", NULL, 0, 0, 0 };
+  nd.times = (double*)malloc(num_scans * repetitions * sizeof(double));
+  ndd.times = (double*)malloc(num_scans * repetitions * sizeof(double));
+
+  // Silence the "emergency stop" messages of both libraries
+  fflush(stdout);
+  fflush(stderr);
+  int saved_out = dup(1), saved_err = dup(2);
+  FILE *quiet = fopen("/dev/null", "w");
+  dup2(fileno(quiet), 1);
+  dup2(fileno(quiet), 2);
+
+  for(rep=0;rep<repetitions;rep++)
+    for(i=0;i<num_scans;i++)
+    {
+      const scan_t *s = &scans[i];
+      double c = cos(s->a), sn = sin(s->a);
+      double t0;
+      unsigned long a0;
+
+      // Both get the points of the scan: ND in the odometric frame,
+      // nddLib in the robot frame
+      mapa.longitud = 0;
+      for(k=0;k<s->n;k++)
+      {
+        double b = s->min_angle + k * s->resolution;
+        double lx = s->ranges[k] * cos(b), ly = s->ranges[k] * sin(b);
+        points[k].x = lx;
+        points[k].y = ly;
+        mapa.punto[k].x = (float)(s->x + lx * c - ly * sn);
+        mapa.punto[k].y = (float)(s->y + lx * sn + ly * c);
+      }
+      mapa.longitud = s->n;
+
+      TInfoMovimiento mov;
+      TCoordenadas goal;
+      mov.SR1.posicion.x = (float)s->x;
+      mov.SR1.posicion.y = (float)s->y;
+      mov.SR1.orientacion = (float)s->a;
+      mov.velocidades.v = 0.2F;
+      mov.velocidades.w = 0.0F;
+      mov.velocidades.v_theta = 0.0F;
+      goal.x = (float)s->gx;
+      goal.y = (float)s->gy;
+
+      NDD_POINT loc_goal;
+      NDD_SPEED_REF sr;
+      double theta;
+      loc_goal.x = (s->gx - s->x) * c + (s->gy - s->y) * sn;
+      loc_goal.y = -(s->gx - s->x) * sn + (s->gy - s->y) * c;
+
+      a0 = allocations;
+      t0 = clockNow();
+      TVelocities *v = IterarND(goal, 0.3F, &mov, &mapa, NULL);
+      nd.times[nd.count++] = clockNow() - t0;
+      nd.allocations += allocations - a0;
+      if(!v || (v->v == 0.0F && v->w == 0.0F))
+        nd.stops++;
+
+      a0 = allocations;
+      t0 = clockNow();
+      nddContextComputeRefFromPoints(&ctx, points, s->n, &loc_goal,
+                                     &theta, &sr);
+      ndd.times[ndd.count++] = clockNow() - t0;
+      ndd.allocations += allocations - a0;
+      if(sr.v == 0.0)
+        ndd.stops++;
+    }
+
+  fflush(stdout);
+  fflush(stderr);
+  dup2(saved_out, 1);
+  dup2(saved_err, 2);
+  fclose(quiet);
+  close(saved_out);
+  close(saved_err);
+
+  printf("scans %d\n", num_scans);
+  printf("repetitions %d\n", repetitions);
+  PrintResult(&nd);
+  PrintResult(&ndd);
+
+  free(nd.times);
+  free(ndd.times);
+  return 0;
+}
@@ -26,12 +26,14 @@
  *
  */
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "nd.h"
 #include "nd2.h"
-//#include <stdlib.h>
 
 #if defined (WIN32)
   #define hypot _hypot
@@ -49,11 +51,18 @@
 FILE *depuracion;
 int iteracion=0;
 
-// Esta variable NO debe declararse como est�tica.
-TInfoRobot robot;
+// Geometria y parametros del robot, una por cada numero de sectores.
+template <int SECTORES>
+typename NucleoND<SECTORES>::TInfoRobot NucleoND<SECTORES>::robot;
+
+// Informacion interna de IterarND(), que se reutiliza de una llamada a otra.
+template <int SECTORES>
+typename NucleoND<SECTORES>::TInfoND NucleoND<SECTORES>::info;
 
 static TVelocities velocidades; // Resultado de IterarND().
 
+static TMetricasND *metricas=NULL; // Perfilado de IterarND() (opcional).
+
 // ----------------------------------------------------------------------------
 // FUNCIONES.
 // ----------------------------------------------------------------------------
@@ -65,8 +74,8 @@ static TVelocities velocidades; // Resultado de IterarND().
 #define INCREMENTAR_SECTOR(s) (((s)+1)%SECTORES)
 #define DECREMENTAR_SECTOR(s) (((s)+(SECTORES-1))%SECTORES)
 
-// Esta funci�n NO debe declararse como est�tica.
-float sector2angulo(int sector) {
+template <int SECTORES>
+float NucleoND<SECTORES>::sector2angulo(int sector) {
   // Sector debe estar entre 0 y SECTORES-1.
 
   #define FACTOR (-(2.0F*M_PI)/SECTORES)
@@ -78,7 +87,8 @@ float sector2angulo(int sector) {
   #undef FACTOR
 }
 
-int angulo2sector(float angulo) {
+template <int SECTORES>
+int NucleoND<SECTORES>::angulo2sector(float angulo) {
   // Angulo debe estar normalizado.
   
   #define FACTOR (-SECTORES/(2.0F*M_PI))
@@ -90,7 +100,8 @@ int angulo2sector(float angulo) {
   #undef FACTOR
 }
 
-static int ObtenerSectorP(TCoordenadasPolares p) {
+template <int SECTORES>
+int NucleoND<SECTORES>::ObtenerSectorP(TCoordenadasPolares p) {
 
   #define FACTOR (-SECTORES/(2.0F*M_PI))
   #define SUMANDO ((SECTORES+1.0F)/2.0F)
@@ -101,7 +112,8 @@ static int ObtenerSectorP(TCoordenadasPolares p) {
   #undef FACTOR
 }
 
-static int DistanciaSectorialOrientada(int s1,int s2) { // Distancia de s1 a s2.
+template <int SECTORES>
+int NucleoND<SECTORES>::DistanciaSectorialOrientada(int s1,int s2) { // Distancia de s1 a s2.
   return (s1<=s2) ? s2-s1 : ((s2+SECTORES)-s1)%SECTORES;
 }
 
@@ -109,7 +121,8 @@ static int DistanciaSectorialOrientada(int s1,int s2) { // Distancia de s1 a s2.
 // InicializarND y sus funciones auxiliares.
 // ----------------------------------------------------------------------------
 
-static void InicializarE(void) {
+template <int SECTORES>
+void NucleoND<SECTORES>::InicializarE(void) {
   // Calcula la distancia desde el origen (punto de coordenadas 0.0F,0.0F)
   // hasta el per�etro (que contiene el origen) en la direcci�n de la bisectriz
   // de cada sector.
@@ -142,7 +155,8 @@ static void InicializarE(void) {
     robot.E[i]=robot.E[SECTORES-i]; // Por simetria respecto del eje X.
 }
 
-static void InicializarERedondo(void) {
+template <int SECTORES>
+void NucleoND<SECTORES>::InicializarERedondo(void) {
   // Calcula la distancia desde el origen (punto de coordenadas 0.0F,0.0F)
   // hasta el per�etro (que contiene el origen) en la direcci�n de la bisectriz
   // de cada sector.
@@ -151,7 +165,8 @@ static void InicializarERedondo(void) {
     robot.E[i]=robot.R;
 }
 
-static void InicializarDSRedondo(float dmax) {
+template <int SECTORES>
+void NucleoND<SECTORES>::InicializarDSRedondo(float dmax) {
   // Calcula la distancia desde el origen (punto de coordenadas 0.0F,0.0F)
   // hasta el per�etro (que contiene el origen) en la direcci�n de la bisectriz
   // de cada sector.
@@ -160,7 +175,8 @@ static void InicializarDSRedondo(float dmax) {
     robot.ds[i]=dmax;
 }
 
-static void InicializarDS(float dsmax,float dsmin) {
+template <int SECTORES>
+void NucleoND<SECTORES>::InicializarDS(float dsmax,float dsmin) {
   TCoordenadas p1,p2;
   TCoordenadas q1,q2,q3;
   TCoordenadasPolares q4;
@@ -241,7 +257,8 @@ static void InicializarDS(float dsmax,float dsmin) {
   robot.ds[SECTORES/2]=q4.r-robot.E[SECTORES/2]; // = q4.x/(float)cos(0.0F) - ...;
 }
 
-void InicializarND(TParametersND *parametros) {
+template <int SECTORES>
+void NucleoND<SECTORES>::InicializarND(TParametersND *parametros) {
 
   /* printf("geom %d\n",parametros->geometriaRect); */
   robot.geometriaRect = parametros->geometryRect;
@@ -299,7 +316,8 @@ void InicializarND(TParametersND *parametros) {
 
 // IterarND / SectorizarMapa
 
-static void SectorizarMapa(TInfoEntorno *mapa,TInfoND *nd) {
+template <int SECTORES>
+void NucleoND<SECTORES>::SectorizarMapa(TInfoEntorno *mapa,TInfoND *nd) {
   TCoordenadas p;
   TCoordenadasPolares pp; // M�dulos al cuadrado para evitar ra�es innecesarias.
   int i,j;
@@ -313,15 +331,19 @@ static void SectorizarMapa(TInfoEntorno *mapa,TInfoND *nd) {
     ConstruirCoordenadasPcC(&pp,p);
 
     j=ObtenerSectorP(pp);
-    if ((nd->d[j].r<0.0F) || (pp.r<nd->d[j].r))
+    if ((nd->d[j].r<0.0F) || (pp.r<nd->d[j].r)) {
       nd->d[j]=pp;
+      nd->c[j]=p;
+    }
   }
 
   for (i=0; i<SECTORES; i++)
     if (nd->d[i].r>=0.0F) {
       nd->d[i].r=RAIZ(nd->d[i].r);
-      if ((i!=SECTORES/2) && (nd->d[i].r<robot.E[i]+0.01F))
+      if ((i!=SECTORES/2) && (nd->d[i].r<robot.E[i]+0.01F)) {
         nd->d[i].r=robot.E[i]+0.01F;
+        ConstruirCoordenadasCP(&(nd->c[i]),nd->d[i]);
+      }
     }
 }
 
@@ -329,7 +351,8 @@ static void SectorizarMapa(TInfoEntorno *mapa,TInfoND *nd) {
 
 // IterarND / ParadaEmergencia
 
-static int ParadaEmergencia(TInfoND *nd) {
+template <int SECTORES>
+int NucleoND<SECTORES>::ParadaEmergencia(TInfoND *nd) {
   // Devuelve 1 si hay peligro de colisi�n y hay que hacer una parada de emergencia;
   // devuelve 0 en caso contrario.
   // En la detecci�n de colisi�n se tiene en cuenta que el robot es sim�trico respecto del eje X.
@@ -353,7 +376,8 @@ static int ParadaEmergencia(TInfoND *nd) {
 
 // IterarND / SeleccionarRegiones / SiguienteDiscontinuidad
 
-static void SiguienteDiscontinuidad(TInfoND *nd,int principio,int izquierda,int *discontinuidad,int *ascendente) {
+template <int SECTORES>
+void NucleoND<SECTORES>::SiguienteDiscontinuidad(TInfoND *nd,int principio,int izquierda,int *discontinuidad,int *ascendente) {
   // Se busca desde "principio" en la direcci�n indicada por "izquierda".
 
   int i,j;
@@ -393,9 +417,19 @@ static void SiguienteDiscontinuidad(TInfoND *nd,int principio,int izquierda,int
   *discontinuidad=-1;
 }
 
+// IterarND / SeleccionarRegiones / ObjetivoAlcanzable / CompararAbscisas
+
+static int CompararAbscisas(const void *a,const void *b) {
+  float xa=((const TCoordenadas*)a)->x;
+  float xb=((const TCoordenadas*)b)->x;
+
+  return (xa<xb) ? -1 : ((xa>xb) ? 1 : 0);
+}
+
 // IterarND / SeleccionarRegiones / ObjetivoAlcanzable
 
-static int ObjetivoAlcanzable(TInfoND *nd,TRegion *region,int direccion_tipo) {
+template <int SECTORES>
+int NucleoND<SECTORES>::ObjetivoAlcanzable(TInfoND *nd,TRegion *region,int direccion_tipo) {
   // "direccion_tipo" puede tomar los siguientes valores declarados en 'nd2.h':
   // - DIRECCION_OBJETIVO
   // - DIRECCION_DISCONTINUIDAD_INICIAL
@@ -409,9 +443,10 @@ static int ObjetivoAlcanzable(TInfoND *nd,TRegion *region,int direccion_tipo) {
 
   int sector_auxiliar;
   float limite;
+  float seno,coseno;
 
   TCoordenadas p1,p2,p;
-  int i,j;
+  int i,j,k;
 
   region->direccion_tipo=direccion_tipo;
 
@@ -447,6 +482,11 @@ static int ObjetivoAlcanzable(TInfoND *nd,TRegion *region,int direccion_tipo) {
   // Determinaci�n de si el objetivo est�Edentro de un C-Obst�culo y
   // construcci�n de las listas de puntos FL y FR.
 
+  // Los obstaculos se giran al SR del objetivo intermedio a partir de sus
+  // coordenadas cartesianas, con un solo seno y coseno por region.
+  seno=(float)sin(region->direccion_angulo);
+  coseno=(float)cos(region->direccion_angulo);
+
   limite=CUADRADO(robot.discontinuidad/2.0F); // Para no hacer ra�es cuadradas dentro del bucle.
   nl=0;
   nr=0;
@@ -454,7 +494,8 @@ static int ObjetivoAlcanzable(TInfoND *nd,TRegion *region,int direccion_tipo) {
     if (nd->d[i].r<0.0F) // Si no existe un obst�culo en el sector actual, pasamos al siguiente sector.
       continue;
 
-    ConstruirCoordenadasCra(&p,nd->d[i].r,nd->d[i].a-region->direccion_angulo);
+    p.x= nd->c[i].x*coseno+nd->c[i].y*seno;
+    p.y=-nd->c[i].x*seno+nd->c[i].y*coseno;
     if ((p.x<0.0F) || (p.x>=objetivo_intermedio.x) || ((float)fabs(p.y)>robot.discontinuidad)) // Si el obst�culo no est�Een el rect�ngulo que consideramos, pasamos al siguiente sector.
       continue;
 
@@ -469,18 +510,30 @@ static int ObjetivoAlcanzable(TInfoND *nd,TRegion *region,int direccion_tipo) {
 
   // Determinaci�n de si los obst�culos nos impiden alcanzar el objetivo intermedio.
 
+  // Barrido en x: con ambas listas ordenadas, para cada punto de FL solo hay
+  // que comparar los de FR cuya abscisa dista menos de "discontinuidad" de la
+  // suya. Esa ventana avanza de forma monotona a lo largo de FR.
+
+  qsort(FL,nl,sizeof(TCoordenadas),CompararAbscisas);
+  qsort(FR,nr,sizeof(TCoordenadas),CompararAbscisas);
+
   limite=CUADRADO(robot.discontinuidad); // Para no hacer ra�es cuadradas dentro de los bucles.
-  for (i=0; i<nl; i++)
-    for (j=0; j<nr; j++)
+  k=0;
+  for (i=0; i<nl; i++) {
+    while ((k<nr) && (FR[k].x<=FL[i].x-robot.discontinuidad))
+      k++;
+    for (j=k; (j<nr) && (FR[j].x<FL[i].x+robot.discontinuidad); j++)
       if (DISTANCIA_CUADRADO2(FL[i],FR[j])<limite)
         return 0; // Objetivo intermedio inalcanzable.
+  }
 
   return 1; // Objetivo intermedio alcanzable.
 }
 
 // IterarND / SeleccionarRegion
 
-static void SeleccionarRegion(TInfoND *nd) {
+template <int SECTORES>
+void NucleoND<SECTORES>::SeleccionarRegion(TInfoND *nd) {
 
   #define IZQUIERDA VERDADERO
   #define DERECHA FALSO
@@ -758,7 +811,10 @@ static void SeleccionarRegion(TInfoND *nd) {
 
     }
 
-  } while ((distancia_izquierda<SECTORES/2) || (distancia_derecha<SECTORES/2));
+  } while (((distancia_izquierda<SECTORES/2) || (distancia_derecha<SECTORES/2)) &&
+           // Cuando la busqueda por un lado sobrepasa el objetivo, el otro lado puede
+           // dar vueltas indefinidamente; no hay mas regiones que sectores.
+           (nd->regiones.longitud<SECTORES-1));
 
   // *region_izquierda == *region_derecha (al menos los campos que determinan la region) y son las dos �ltimas del vector.
   nd->regiones.longitud--;
@@ -772,7 +828,8 @@ static void SeleccionarRegion(TInfoND *nd) {
 
 // IterarND / ConstruirDR
 
-static void ConstruirDR(TInfoND *nd) {
+template <int SECTORES>
+void NucleoND<SECTORES>::ConstruirDR(TInfoND *nd) {
   int i;
 
   for (i=0; i<SECTORES; i++)
@@ -792,7 +849,8 @@ static void ActualizarMinimo(int *sector_minimo,float *valor_minimo,int sector,f
 
 // IterarND / control_angulo / ObtenerObstaculos
 
-static void ObtenerObstaculos(TInfoND *nd,float beta) {
+template <int SECTORES>
+void NucleoND<SECTORES>::ObtenerObstaculos(TInfoND *nd,float beta) {
   // Buscamos todos los obst�culos que est�n dentro de la distancia de seguridad y nos quedamos
   // con el m�s cercano por la izquierda y el m�s cercano por la derecha.
   // El obst�culo m�s cercano es el de menor dr/ds.
@@ -830,13 +888,15 @@ static void ObtenerObstaculos(TInfoND *nd,float beta) {
 
 // IterarND / control_angulo / solHSGR
 
-static float solHSGR(TInfoND *nd) {
+template <int SECTORES>
+float NucleoND<SECTORES>::solHSGR(TInfoND *nd) {
   return nd->regiones.vector[nd->region].direccion_angulo;
 }
 
 // IterarND / control_angulo / solHSNR
 
-static float solHSNR(TInfoND *nd) {
+template <int SECTORES>
+float NucleoND<SECTORES>::solHSNR(TInfoND *nd) {
   TRegion *region=&(nd->regiones.vector[nd->region]);
   int final=region->final;
   if (region->principio>region->final)
@@ -847,7 +907,8 @@ static float solHSNR(TInfoND *nd) {
 
 // IterarND / control_angulo / solHSWR
 
-static float solHSWR(TInfoND *nd) {
+template <int SECTORES>
+float NucleoND<SECTORES>::solHSWR(TInfoND *nd) {
   TRegion *region=&(nd->regiones.vector[nd->region]);
 
   if (region->direccion_tipo==DIRECCION_DISCONTINUIDAD_INICIAL)
@@ -860,7 +921,8 @@ static float solHSWR(TInfoND *nd) {
 
 // IterarND / control_angulo / solLS1
 
-static float solLS1(TInfoND *nd) {
+template <int SECTORES>
+float NucleoND<SECTORES>::solLS1(TInfoND *nd) {
   TRegion *region=&(nd->regiones.vector[nd->region]);
   //float angulo_objetivo=nd->regiones.vector[nd->region].direccion_angulo;
   float anguloPrueba;
@@ -906,7 +968,8 @@ static float solLS1(TInfoND *nd) {
 
 // IterarND / control_angulo / solLSG
 
-static float solLSG(TInfoND *nd){
+template <int SECTORES>
+float NucleoND<SECTORES>::solLSG(TInfoND *nd){
 
   float angulo_parcial,dist_obs_dsegur,angulo_cota,anguloPrueba;
 
@@ -939,7 +1002,8 @@ static float solLSG(TInfoND *nd){
 
 // IterarND / control_angulo / solLS2
 
-static float solLS2(TInfoND *nd) {
+template <int SECTORES>
+float NucleoND<SECTORES>::solLS2(TInfoND *nd) {
   float ci = nd->dr[nd->obstaculo_izquierda]/robot.ds[nd->obstaculo_izquierda];
   float cd = nd->dr[nd->obstaculo_derecha]/robot.ds[nd->obstaculo_derecha];
   float ad,ai; // �ngulos cota izquierdo y derecho.
@@ -962,7 +1026,8 @@ static float solLS2(TInfoND *nd) {
 
 // IterarND / control_angulo
 
-static void control_angulo(TInfoND *nd) {
+template <int SECTORES>
+void NucleoND<SECTORES>::control_angulo(TInfoND *nd) {
   // C�lculo del �ngulo de movimiento en funci�n de la regi�n escogida para el movimiento del robot, la situaci�n del objetivo y,
   // en su caso, la distancia a los obst�culos m�s pr�ximos. 
 
@@ -975,34 +1040,34 @@ static void control_angulo(TInfoND *nd) {
 
   if (nd->obstaculo_izquierda == -1 && nd->obstaculo_derecha == -1 ) {
     if (region->direccion_tipo==DIRECCION_OBJETIVO) {
-      sprintf(nd->situacion,"HSGR");
+      nd->situacion=ND_SITUACION_HSGR;
       nd->angulosin= solHSGR(nd);
       nd->angulo=nd->angulosin;
     }
     else if (final - nd->regiones.vector[nd->region].principio > SECTORES/4) {
-      sprintf(nd->situacion,"HSWR");
+      nd->situacion=ND_SITUACION_HSWR;
       nd->angulosin= solHSWR(nd);
       nd->angulo=nd->angulosin;
     }
     else {
-      sprintf(nd->situacion,"HSNR");
+      nd->situacion=ND_SITUACION_HSNR;
       nd->angulosin= solHSNR(nd);
       nd->angulo=nd->angulosin;
     }
   }
   else {
     if ( nd->obstaculo_izquierda!=-1 && nd->obstaculo_derecha!=-1) {
-      sprintf(nd->situacion,"LS2");
+      nd->situacion=ND_SITUACION_LS2;
       nd->angulo=solLS2(nd);
       nd->angulosin=nd->angulo;
     }
     else if (region->direccion_tipo==DIRECCION_OBJETIVO ) {
-      sprintf(nd->situacion,"LSG");
+      nd->situacion=ND_SITUACION_LSG;
       nd->angulo=solLSG(nd);
       nd->angulosin=nd->angulo;
     }
     else {
-      sprintf(nd->situacion,"LS1");
+      nd->situacion=ND_SITUACION_LS1;
       nd->angulo=solLS1(nd);
       nd->angulosin=nd->angulo;
     }
@@ -1015,7 +1080,8 @@ static void control_angulo(TInfoND *nd) {
 
 // IterarND / control_velocidad
 
-static void control_velocidad(TInfoND *nd) {
+template <int SECTORES>
+void NucleoND<SECTORES>::control_velocidad(TInfoND *nd) {
 
   // Velocidad lineal del robot.
 
@@ -1029,7 +1095,8 @@ static void control_velocidad(TInfoND *nd) {
 
 // Cutting / GenerarMovimientoFicticio
 
-static void GenerarMovimientoFicticio(TInfoND *nd,float angulo,TVelocities *velocidades) {
+template <int SECTORES>
+void NucleoND<SECTORES>::GenerarMovimientoFicticio(TInfoND *nd,float angulo,TVelocities *velocidades) {
   float ci=(nd->obstaculo_izquierda!=-1) ? nd->dr[nd->obstaculo_izquierda]/robot.ds[nd->obstaculo_izquierda] : 1.0F; // Coeficiente de distancia por la izquierda.
   float cd=(nd->obstaculo_derecha!=-1) ? nd->dr[nd->obstaculo_derecha]/robot.ds[nd->obstaculo_derecha] : 1.0F; // Coeficiente de distancia por la derecha.
   float cvmax=MAXIMO(0.2F,MINIMO(ci,cd));
@@ -1058,7 +1125,8 @@ static void GenerarMovimientoFicticio(TInfoND *nd,float angulo,TVelocities *velo
 
 // GiroBrusco
 
-static void GiroBrusco(TInfoND *nd,TVelocities *velocidades) {
+template <int SECTORES>
+void NucleoND<SECTORES>::GiroBrusco(TInfoND *nd,TVelocities *velocidades) {
   TCoordenadasPolares esquina;
   int derecha,izquierda;
 
@@ -1085,7 +1153,8 @@ static void GiroBrusco(TInfoND *nd,TVelocities *velocidades) {
 #define CUTTING_DERECHA   2
 #define CUTTING_AMBOS     3
 
-static int ObtenerSituacionCutting(TInfoND *nd,float w) {
+template <int SECTORES>
+int NucleoND<SECTORES>::ObtenerSituacionCutting(TInfoND *nd,float w) {
   TCoordenadas p;
   int resultado=CUTTING_NINGUNO;
   int obstaculo_izquierda=0;
@@ -1096,7 +1165,7 @@ static int ObtenerSituacionCutting(TInfoND *nd,float w) {
 
   i=0;
   while (i<SECTORES) {
-    if (((nd->d[i].a<-M_PI/2.0F) || (nd->d[i].a>M_PI/2.0F)) && (nd->d[i].r>=0.0F) && (nd->dr[i]<=robot.enlarge/2.0F)) {
+    if ((nd->d[i].r>=0.0F) && ((nd->d[i].a<-M_PI/2.0F) || (nd->d[i].a>M_PI/2.0F)) && (nd->dr[i]<=robot.enlarge/2.0F)) {
 
       ConstruirCoordenadasCP(&p,nd->d[i]);
 
@@ -1130,7 +1199,8 @@ static int ObtenerSituacionCutting(TInfoND *nd,float w) {
 
 // Cutting / AnguloSinRotacion
 
-static float AnguloSinRotacion(TInfoND *nd,TVelocities *velocidades) {
+template <int SECTORES>
+float NucleoND<SECTORES>::AnguloSinRotacion(TInfoND *nd,TVelocities *velocidades) {
   TCoordenadas F;
   float angulo;
 
@@ -1156,26 +1226,27 @@ static float AnguloSinRotacion(TInfoND *nd,TVelocities *velocidades) {
 
 // Cutting
 
-static void Cutting(TInfoND *nd, TVelocities *velocidades) {
+template <int SECTORES>
+void NucleoND<SECTORES>::Cutting(TInfoND *nd, TVelocities *velocidades) {
   switch (ObtenerSituacionCutting(nd,velocidades->w)) {
     case CUTTING_NINGUNO:
-      sprintf(nd->cutting,"NINGUNO");
+      nd->cutting=ND_CUTTING_NINGUNO;
       return;
 
     case CUTTING_IZQUIERDA:
-      sprintf(nd->cutting,"IZQUIERDA");
+      nd->cutting=ND_CUTTING_IZQUIERDA;
       if (velocidades->w>=0.0F)
 	return;
       break;
 
     case CUTTING_DERECHA:
-      sprintf(nd->cutting,"DERECHA");
+      nd->cutting=ND_CUTTING_DERECHA;
       if (velocidades->w<=0.0F)
 	return;
       break;
 
     case CUTTING_AMBOS:
-      sprintf(nd->cutting,"AMBOS");
+      nd->cutting=ND_CUTTING_AMBOS;
   }
 
   nd->angulo=AnguloSinRotacion(nd,velocidades);
@@ -1213,9 +1284,111 @@ static void GenerarMovimiento(TInfoND *nd,TVelocities *velocidades) {
 
 // ----------------------------------------------------------------------------
 
+// Perfilado
+
+static const char *nombres_fases[ND_NUM_FASES]={
+  "SectorizarMapa","ParadaEmergencia","SeleccionarRegion","ConstruirDR",
+  "control","GenerarMovimientoFicticio","Cutting"};
+static const char *nombres_situaciones[ND_NUM_SITUACIONES]={
+  "HSGR","HSWR","HSNR","LS2","LSG","LS1"};
+static const char *nombres_cutting[ND_NUM_CUTTING]={
+  "NINGUNO","IZQUIERDA","DERECHA","AMBOS"};
+
+static double Reloj(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1e-9;
+}
+
+static void AcumularFase(int fase,double t0) {
+  double t=Reloj()-t0;
+
+  metricas->tiempo[fase]+=t;
+  if (t>metricas->tiempo_max[fase])
+    metricas->tiempo_max[fase]=t;
+  metricas->fases[fase]++;
+}
+
+// Ejecuta una fase de IterarND midiendo su duracion si hay perfilado.
+#define FASE(fase,llamada) \
+  if (metricas) { \
+    double t0=Reloj(); \
+    llamada; \
+    AcumularFase(fase,t0); \
+  } else { \
+    llamada; \
+  }
+
+void MetricasND(TMetricasND *m) {
+  metricas=m;
+}
+
+const char *NombreFaseND(int fase) {
+  return (fase>=0 && fase<ND_NUM_FASES) ? nombres_fases[fase] : "?";
+}
+
+const char *NombreSituacionND(int situacion) {
+  return (situacion>=0 && situacion<ND_NUM_SITUACIONES) ? nombres_situaciones[situacion] : "?";
+}
+
+const char *NombreCuttingND(int cutting) {
+  return (cutting>=0 && cutting<ND_NUM_CUTTING) ? nombres_cutting[cutting] : "?";
+}
+
+void ImprimirMetricasND(FILE *fichero, const TMetricasND *m) {
+  int i;
+
+  fprintf(fichero,"iteraciones %lu\n",m->iteraciones);
+  fprintf(fichero,"paradas %lu\n",m->paradas);
+  fprintf(fichero,"sin_region %lu\n",m->sin_region);
+  for (i=0; i<ND_NUM_FASES; i++)
+    fprintf(fichero,"fase %s %lu %.9f %.9f\n",nombres_fases[i],
+            m->fases[i],m->tiempo[i],m->tiempo_max[i]);
+  for (i=0; i<ND_NUM_SITUACIONES; i++)
+    fprintf(fichero,"situacion %s %lu\n",nombres_situaciones[i],m->situaciones[i]);
+  for (i=0; i<ND_NUM_CUTTING; i++)
+    fprintf(fichero,"cutting %s %lu\n",nombres_cutting[i],m->cutting[i]);
+}
+
+// ----------------------------------------------------------------------------
+
+// IterarND / Diagnosticar
+
+static TDiagnosticoND diagnostico; // Resumen de la ultima llamada a IterarND().
+
+const TDiagnosticoND *DiagnosticoND(void) {
+  return &diagnostico;
+}
+
+template <int SECTORES>
+void NucleoND<SECTORES>::Diagnosticar(const TInfoND &nd,void *informacion) {
+  diagnostico.sectores=SECTORES;
+  diagnostico.region=nd.region;
+  if (nd.region>=0) {
+    diagnostico.region_principio=nd.regiones.vector[nd.region].principio;
+    diagnostico.region_final=nd.regiones.vector[nd.region].final;
+  } else {
+    diagnostico.region_principio=-1;
+    diagnostico.region_final=-1;
+  }
+  diagnostico.obstaculo_izquierda=nd.obstaculo_izquierda;
+  diagnostico.obstaculo_derecha=nd.obstaculo_derecha;
+  diagnostico.angulo=nd.angulo;
+  diagnostico.velocidad=nd.velocidad;
+  diagnostico.situacion=nd.situacion;
+  diagnostico.cutting=nd.cutting;
+
+  if (informacion)
+    *(TInfoND*)informacion=nd;
+}
+
+// ----------------------------------------------------------------------------
+
 // IterarND
 
-TVelocities *IterarND(TCoordenadas objetivo,
+template <int SECTORES>
+TVelocities *NucleoND<SECTORES>::IterarND(TCoordenadas objetivo,
                       float goal_tol,
                       TInfoMovimiento *movimiento,
                       TInfoEntorno *mapa,void *informacion) 
@@ -1224,12 +1397,19 @@ TVelocities *IterarND(TCoordenadas objetivo,
   // Devuelve NULL si se requiere una parada de emergencia o si no encuentra una regi�n por la que hacer avanzar el robot.
   // Devuelve un puntero a (0.0F,0.0F) si se ha alcanzado el objetivo.
 
-  TInfoND nd;
+  // La informacion interna se conserva entre llamadas: todos los campos que se
+  // leen se escriben antes en cada iteracion, salvo los que solo se calculan en
+  // algunos casos, que se reinician aqui.
+  TInfoND &nd=info;
+  int parada;
 
-  // Valgrind says that some of the values in this nd structure are
-  // uninitialized when it's accessed in ObtenerSituacionCutting(), so I'm
-  // zeroing it here.  - BPG
-  memset(&nd, 0, sizeof(TInfoND));
+  nd.region=-1;
+  nd.situacion=ND_SITUACION_NINGUNA;
+  nd.cutting=ND_CUTTING_NINGUNO;
+  nd.obstaculo_izquierda=-1;
+  nd.obstaculo_derecha=-1;
+  nd.angulo=0.0F;
+  nd.velocidad=0.0F;
 
 //depuracion=fopen("depuracion.txt","at");
   // Tratamiento de los par�metros "objetivo" y "movimiento".
@@ -1245,29 +1425,40 @@ TVelocities *IterarND(TCoordenadas objetivo,
 
   nd.objetivo.s=ObtenerSectorP(nd.objetivo.p1);
 
+  if (metricas)
+    metricas->iteraciones++;
+
   // Sectorizaci�n del mapa.
 
-  SectorizarMapa(mapa,&nd);
+  FASE(ND_FASE_SECTORIZAR,SectorizarMapa(mapa,&nd))
 
   // Evaluaci�n de la necesidad de una parada de emergencia.
   // Solo en el caso de robot rectangular
-  if (robot.geometriaRect==1)
-	  if (ParadaEmergencia(&nd)) {
+  if (robot.geometriaRect==1) {
+	  FASE(ND_FASE_PARADA,parada=ParadaEmergencia(&nd))
+	  if (parada) {
+		  if (metricas)
+			  metricas->paradas++;
 		  printf("ND -> Parada Emergencia\n");
+		  Diagnosticar(nd,informacion);
 		  return 0;
 	  }
+  }
 
   // Selecci�n de la regi�n por la cual avanzar�Eel robot.
 
-  SeleccionarRegion(&nd);
+  FASE(ND_FASE_REGION,SeleccionarRegion(&nd))
   if (nd.region<0) {
+	  if (metricas)
+		  metricas->sin_region++;
 	  printf("ND -> No encuentra region\n");
+	  Diagnosticar(nd,informacion);
 	  return 0;
   }
 
   // Construcci�n de la distancia desde el per�etro del robot al obst�culo m�s cercano en cada sector.
 
-  ConstruirDR(&nd);
+  FASE(ND_FASE_DR,ConstruirDR(&nd))
 
   // Deteccion de fin de trayecto. -- Despu�s de considerar la necesidad de una parada de emergencia.
   // Caso geometria rectangular
@@ -1284,6 +1475,7 @@ TVelocities *IterarND(TCoordenadas objetivo,
       // Ya hemos llegado.
       velocidades.v=0.0F;
       velocidades.w=0.0F;
+      Diagnosticar(nd,informacion);
       return &velocidades;
     }
   }
@@ -1291,14 +1483,18 @@ TVelocities *IterarND(TCoordenadas objetivo,
     // Redondo
     velocidades.v=0.0F;
     velocidades.w=0.0F;
+    Diagnosticar(nd,informacion);
     return &velocidades;
   }
   
 
 
   // C�lculo del movimiento del robot.
-  control_angulo(&nd); // Obtenci�n de la direcci�n de movimiento.
-  control_velocidad(&nd); // Obtenci�n de la velocidad de movimiento.
+  FASE(ND_FASE_CONTROL,
+       control_angulo(&nd);   // Obtenci�n de la direcci�n de movimiento.
+       control_velocidad(&nd)) // Obtenci�n de la velocidad de movimiento.
+  if (metricas)
+    metricas->situaciones[nd.situacion]++;
 //  if (nd.velocidad<0.05F)
 //    nd.velocidad=0.05F;
   nd.velocidad=robot.velocidad_lineal_maxima;
@@ -1328,15 +1524,18 @@ TVelocities *IterarND(TCoordenadas objetivo,
 //   printf("Movimiento No Holonomo\n");
     // Calculo del movimiento Generador de movimientos
 //**/printf("<Vnd,And>=<%f,%f>\n",nd.velocidad,nd.angulo);
-    GenerarMovimientoFicticio(&nd,nd.angulo,&velocidades);
+    FASE(ND_FASE_MOVIMIENTO,GenerarMovimientoFicticio(&nd,nd.angulo,&velocidades))
 //**/printf("<Vr,Wr>=<%f,%f>\n",velocidades.v,velocidades.w);
     
     // Aplicar correcciones al movimiento calculado.
     if (robot.geometriaRect==1){
       // Cuadrado
-      GiroBrusco(&nd,&velocidades);
+      FASE(ND_FASE_CUTTING,
+           GiroBrusco(&nd,&velocidades);
 /*       printf("Entra en cutting %d\n",robot.geometriaRect); */
-      Cutting(&nd,&velocidades); // Evitar colisi�n en zona posterior.
+           Cutting(&nd,&velocidades)) // Evitar colisi�n en zona posterior.
+      if (metricas)
+        metricas->cutting[nd.cutting]++;
     }
   }
 
@@ -1349,13 +1548,215 @@ TVelocities *IterarND(TCoordenadas objetivo,
 
 /*     printf("w = %f\n",velocidades.w);   */
   
-  // Copia (si se requiere) de la informaci�n interna de ND para que quede accesible desde el exterior.
-  
-  if (informacion)
-    *(TInfoND*)informacion=nd;
-  
+  // Resumen (y copia, si se requiere) de la informacion interna de ND para que quede accesible desde el exterior.
+
+  Diagnosticar(nd,informacion);
+
   // Devoluci�n de resultados.
 
 //fclose(depuracion);
   return &velocidades;
 }
+
+// ----------------------------------------------------------------------------
+
+// EvaluarObjetivos / EvaluarObjetivo
+
+template <int SECTORES>
+void NucleoND<SECTORES>::EvaluarObjetivo(TInfoND *nd,TObjetivoND *objetivo) {
+  // "nd" ya contiene el mapa sectorizado y dr; solo cambia el objetivo.
+
+  TRegion *region;
+
+  nd->objetivo.c0=objetivo->objetivo;
+  nd->objetivo.c1=nd->objetivo.c0;
+  TRANSFORMACION01(&(nd->SR1),&(nd->objetivo.c1))
+  ConstruirCoordenadasPC(&(nd->objetivo.p1),nd->objetivo.c1);
+  nd->objetivo.s=ObtenerSectorP(nd->objetivo.p1);
+
+  nd->situacion=ND_SITUACION_NINGUNA;
+
+  SeleccionarRegion(nd);
+  if (nd->region<0) {
+    objetivo->alcanzable=0;
+    objetivo->region_principio=-1;
+    objetivo->region_final=-1;
+    objetivo->direccion=0.0F;
+    objetivo->angulo=0.0F;
+    objetivo->situacion=ND_SITUACION_NINGUNA;
+    return;
+  }
+
+  control_angulo(nd);
+
+  region=&(nd->regiones.vector[nd->region]);
+  objetivo->alcanzable=1;
+  objetivo->region_principio=region->principio;
+  objetivo->region_final=region->final;
+  objetivo->direccion=region->direccion_angulo;
+  objetivo->angulo=nd->angulo;
+  objetivo->situacion=nd->situacion;
+}
+
+// EvaluarObjetivos / EvaluarObjetivosHilo
+
+template <int SECTORES>
+void *NucleoND<SECTORES>::EvaluarObjetivosHilo(void *trabajo) {
+  TTrabajoObjetivos *t=(TTrabajoObjetivos*)trabajo;
+  int i;
+
+  for (i=t->primero; i<t->n; i+=t->paso)
+    EvaluarObjetivo(t->nd,&(t->objetivos[i]));
+  return NULL;
+}
+
+// EvaluarObjetivos
+
+#define MAX_HILOS_OBJETIVOS 16
+
+template <int SECTORES>
+int NucleoND<SECTORES>::EvaluarObjetivos(TObjetivoND *objetivos,int n,
+                                         TInfoMovimiento *movimiento,
+                                         TInfoEntorno *mapa,
+                                         int hilos)
+{
+  // Se usa la misma informacion interna que IterarND, que la reescribe por
+  // completo en cada iteracion. Los hilos adicionales trabajan sobre copias.
+
+  TInfoND &nd=info;
+  TInfoND *copias=NULL;
+  TTrabajoObjetivos trabajos[MAX_HILOS_OBJETIVOS];
+  pthread_t identificadores[MAX_HILOS_OBJETIVOS];
+  int lanzado[MAX_HILOS_OBJETIVOS];
+  int i,alcanzables;
+
+  nd.SR1=movimiento->SR1;
+  nd.velocidades=movimiento->velocidades;
+
+  SectorizarMapa(mapa,&nd);
+
+  if ((robot.geometriaRect==1) && ParadaEmergencia(&nd)) {
+    for (i=0; i<n; i++) {
+      objetivos[i].alcanzable=0;
+      objetivos[i].region_principio=-1;
+      objetivos[i].region_final=-1;
+      objetivos[i].direccion=0.0F;
+      objetivos[i].angulo=0.0F;
+      objetivos[i].situacion=ND_SITUACION_NINGUNA;
+    }
+    return -1;
+  }
+
+  ConstruirDR(&nd);
+
+  if (hilos>n)
+    hilos=n;
+  if (hilos>MAX_HILOS_OBJETIVOS)
+    hilos=MAX_HILOS_OBJETIVOS;
+  if (hilos>1) {
+    copias=(TInfoND*)malloc((hilos-1)*sizeof(TInfoND));
+    if (!copias)
+      hilos=1;
+  }
+  if (hilos<1)
+    hilos=1;
+
+  for (i=0; i<hilos; i++) {
+    trabajos[i].nd=(i==0) ? &nd : &(copias[i-1]);
+    trabajos[i].objetivos=objetivos;
+    trabajos[i].n=n;
+    trabajos[i].primero=i;
+    trabajos[i].paso=hilos;
+    lanzado[i]=0;
+  }
+
+  // Si no se puede crear un hilo, su parte se hace en este.
+  for (i=1; i<hilos; i++) {
+    copias[i-1]=nd;
+    lanzado[i]=(pthread_create(&(identificadores[i]),NULL,EvaluarObjetivosHilo,&(trabajos[i]))==0);
+  }
+  EvaluarObjetivosHilo(&(trabajos[0]));
+  for (i=1; i<hilos; i++)
+    if (lanzado[i])
+      pthread_join(identificadores[i],NULL);
+    else
+      EvaluarObjetivosHilo(&(trabajos[i]));
+
+  free(copias);
+
+  alcanzables=0;
+  for (i=0; i<n; i++)
+    alcanzables+=objetivos[i].alcanzable;
+  return alcanzables;
+}
+
+#undef MAX_HILOS_OBJETIVOS
+
+// ----------------------------------------------------------------------------
+
+// Seleccion del numero de sectores
+
+template class NucleoND<88>;
+template class NucleoND<180>;
+template class NucleoND<360>;
+template class NucleoND<720>;
+
+typedef TVelocities *(*TIterarND)(TCoordenadas,float,TInfoMovimiento*,TInfoEntorno*,void*);
+typedef int (*TEvaluarObjetivosND)(TObjetivoND*,int,TInfoMovimiento*,TInfoEntorno*,int);
+
+static int sectores=180;
+static TIterarND iterar=NucleoND<180>::IterarND;
+static TEvaluarObjetivosND evaluar=NucleoND<180>::EvaluarObjetivos;
+
+void InicializarND(TParametersND *parametros) {
+  switch (parametros->sectors) {
+    case 88:
+      sectores=88;
+      NucleoND<88>::InicializarND(parametros);
+      iterar=NucleoND<88>::IterarND;
+      evaluar=NucleoND<88>::EvaluarObjetivos;
+      break;
+
+    case 360:
+      sectores=360;
+      NucleoND<360>::InicializarND(parametros);
+      iterar=NucleoND<360>::IterarND;
+      evaluar=NucleoND<360>::EvaluarObjetivos;
+      break;
+
+    case 720:
+      sectores=720;
+      NucleoND<720>::InicializarND(parametros);
+      iterar=NucleoND<720>::IterarND;
+      evaluar=NucleoND<720>::EvaluarObjetivos;
+      break;
+
+    default:
+      if (parametros->sectors!=0 && parametros->sectors!=180)
+        printf("ND -> %d sectores no disponibles, se usan 180\n",parametros->sectors);
+      sectores=180;
+      NucleoND<180>::InicializarND(parametros);
+      iterar=NucleoND<180>::IterarND;
+      evaluar=NucleoND<180>::EvaluarObjetivos;
+  }
+}
+
+TVelocities *IterarND(TCoordenadas objetivo,
+                      float goal_tol,
+                      TInfoMovimiento *movimiento,
+                      TInfoEntorno *mapa,void *informacion)
+{
+  return iterar(objetivo,goal_tol,movimiento,mapa,informacion);
+}
+
+int EvaluarObjetivosND(TObjetivoND *objetivos, int n,
+                       TInfoMovimiento *movimiento,
+                       TInfoEntorno *mapa,
+                       int hilos)
+{
+  return evaluar(objetivos,n,movimiento,mapa,hilos);
+}
+
+int SectoresND(void) {
+  return sectores;
+}
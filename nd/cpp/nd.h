@@ -46,6 +46,8 @@
 #ifndef nd_h
 #define nd_h
 
+#include <stdio.h>
+
 // ----------------------------------------------------------------------------
 // GENERIC TYPES
 // ----------------------------------------------------------------------------
@@ -120,6 +122,11 @@ typedef struct {
   // -- SAMPLING PERIOD --
   float T;
 
+  // -- SECTORS --
+  // Angular resolution of the nearness diagram: 88, 180, 360 or 720 sectors.
+  // 0 selects the default (180).
+  int sectors;
+
   // LASER
   // Distance from the wheels axis to the laser, X axis.
   //float laser;					
@@ -185,6 +192,101 @@ typedef struct {
 
 
 
+// ************************
+
+// TMetricasND	(profiling of the internal phases of IterarND)
+
+// Phases of one iteration
+#define ND_FASE_SECTORIZAR   0	// SectorizarMapa
+#define ND_FASE_PARADA       1	// ParadaEmergencia
+#define ND_FASE_REGION       2	// SeleccionarRegion
+#define ND_FASE_DR           3	// ConstruirDR
+#define ND_FASE_CONTROL      4	// control_angulo and control_velocidad
+#define ND_FASE_MOVIMIENTO   5	// GenerarMovimientoFicticio
+#define ND_FASE_CUTTING      6	// GiroBrusco and Cutting
+#define ND_NUM_FASES         7
+
+// Situations selected by control_angulo
+typedef enum {
+  ND_SITUACION_NINGUNA=-1,	// not computed (goal reached, stop...)
+  ND_SITUACION_HSGR,
+  ND_SITUACION_HSWR,
+  ND_SITUACION_HSNR,
+  ND_SITUACION_LS2,
+  ND_SITUACION_LSG,
+  ND_SITUACION_LS1,
+  ND_NUM_SITUACIONES
+} TSituacionND;
+
+// Corrections applied by Cutting
+typedef enum {
+  ND_CUTTING_NINGUNO,
+  ND_CUTTING_IZQUIERDA,
+  ND_CUTTING_DERECHA,
+  ND_CUTTING_AMBOS,
+  ND_NUM_CUTTING
+} TCuttingND;
+
+typedef struct {
+  unsigned long iteraciones;		// calls to IterarND
+  unsigned long paradas;		// emergency stops
+  unsigned long sin_region;		// no free region found
+  double tiempo[ND_NUM_FASES];		// accumulated wall-clock time (s)
+  double tiempo_max[ND_NUM_FASES];	// worst time of a single call (s)
+  unsigned long fases[ND_NUM_FASES];	// times each phase was run
+  unsigned long situaciones[ND_NUM_SITUACIONES];
+  unsigned long cutting[ND_NUM_CUTTING];
+} TMetricasND;
+
+// **************************************
+
+
+
+
+
+// ************************
+
+// TDiagnosticoND	(outcome of the last call to IterarND)
+
+typedef struct {
+  int sectores;			// sectors of the nearness diagram in use
+  int region;			// index of the selected region, -1 if none
+  int region_principio;		// first and last sectors of that region
+  int region_final;
+  int obstaculo_izquierda;	// sector of the closest obstacle on each side,
+  int obstaculo_derecha;	// -1 if none
+  float angulo;			// direction of motion in the robot frame (rad)
+  float velocidad;		// linear velocity before the motion generator
+  TSituacionND situacion;
+  TCuttingND cutting;
+} TDiagnosticoND;
+
+// **************************************
+
+
+
+
+
+// ************************
+
+// TObjetivoND	(one candidate goal for EvaluarObjetivosND)
+
+typedef struct {
+  TCoordenadas objetivo;	// input: goal in GLOBAL coordinates
+  int alcanzable;		// 1 if a region leads towards the goal, 0 if not
+  int region_principio;		// first and last sectors of that region, -1 if none
+  int region_final;
+  float direccion;		// direction of the region in the robot frame (rad)
+  float angulo;			// direction of motion given by control_angulo (rad)
+  TSituacionND situacion;
+} TObjetivoND;
+
+// **************************************
+
+
+
+
+
 // ----------------------------------------------------------------------------
 // FUNCTIONS
 // ----------------------------------------------------------------------------
@@ -231,6 +333,70 @@ extern TVelocities *IterarND(TCoordenadas objetivo,
                              TInfoEntorno *mapa,
                              void *informacion);
     // if you do not want to see the internal information in nh2.h informacion = NULL
+    // (copying it is expensive; DiagnosticoND gives a summary for free)
+
+// **********************************
+
+
+
+
+
+
+// **********************************
+// Summary of the decisions taken by the last call to IterarND. The pointer
+// stays valid and is overwritten by the following call.
+
+extern const TDiagnosticoND *DiagnosticoND(void);
+
+// **********************************
+
+
+
+
+
+
+// **********************************
+// Evaluates several candidate goals against the same obstacle list. The map
+// is sectorised once for the current location and then the region selection
+// and control_angulo are run for every goal, without moving the robot.
+// It does not touch the state returned by DiagnosticoND.
+// Input--
+//		objetivos:: n goals; the other fields are filled on return.
+//		movimiento, mapa:: as in IterarND.
+//		hilos:: number of threads among which the goals are shared (<=1: none).
+// Ouput--
+//		number of reachable goals, or -1 if an emergency stop is required
+//		(then every goal is marked as unreachable).
+
+extern int EvaluarObjetivosND(TObjetivoND *objetivos, int n,
+                              TInfoMovimiento *movimiento,
+                              TInfoEntorno *mapa,
+                              int hilos);
+
+// **********************************
+
+
+
+
+
+
+// **********************************
+// Profiling of the ND. Once a block is given, every call to IterarND 
+// accumulates in it the time spent in each phase and the situation chosen.
+// The block is only written by the thread that calls IterarND, so it needs
+// no locking as long as it is also read from that thread.
+// Input--
+//		metricas:: block to fill, or NULL to stop profiling.
+
+extern void MetricasND(TMetricasND *metricas);
+
+// Names of the phases, situations and cutting corrections (for reports).
+extern const char *NombreFaseND(int fase);
+extern const char *NombreSituacionND(int situacion);
+extern const char *NombreCuttingND(int cutting);
+
+// Writes the block as "key value" lines.
+extern void ImprimirMetricasND(FILE *fichero, const TMetricasND *metricas);
 
 // **********************************
 
@@ -27,14 +27,12 @@
 #define nd2_h
 
 #include "geometria.h"
+#include "nd.h"
 
 // ----------------------------------------------------------------------------
 // CONSTANTES.
 // ----------------------------------------------------------------------------
 
-// N�mero de sectores: m�ltiplo de 4.
-#define SECTORES 180
-
 #define VERDADERO 1
 #define FALSO 0
 #define NO_SIGNIFICATIVO -1
@@ -57,35 +55,6 @@ typedef float TDimensiones[4];
 
 typedef float TMatriz2x2[2][2];
 
-typedef struct {
-
-  TDimensiones Dimensiones;
-  float enlarge;
-
-  short int geometriaRect; // Si es cuadrado o no
-
-  float R; // radio del robot por si es circular
-
-  short int holonomo;
-
-  float E[SECTORES]; // Distancia desde el origen de SR2 al per�metro del robot.
-  float ds[SECTORES];  // Distancia de seguridad: desde el per�metro del robot al per�metro de seguridad.
-
-  float velocidad_lineal_maxima;
-  float velocidad_angular_maxima;
-
-  float aceleracion_lineal_maxima;
-  float aceleracion_angular_maxima;
-
-  float discontinuidad; // Espacio m�nimo por el que cabe el robot.
-
-  float T; // Per�odo.
-
-  TMatriz2x2 H; // Generador de movimientos: "Inercia" del robot.
-  TMatriz2x2 G; // Generador de movimientos: "Fuerza" aplicada sobre el robot.
-
-} TInfoRobot;
-
 // Informaci�n acerca del objetivo.
 
 typedef struct {
@@ -115,51 +84,163 @@ typedef struct {
   float direccion_angulo;
 } TRegion;
 
-typedef struct {
-  int longitud;
-  TRegion vector[SECTORES];
-} TVRegiones;
 
-// Informaci�n interna del m�todo de navegaci�n.
 
-typedef struct {
+// ----------------------------------------------------------------------------
+// NUCLEO.
+// ----------------------------------------------------------------------------
 
-  TObjetivo objetivo;
+// El numero de sectores es un parametro de la plantilla, de modo que los
+// vectores por sector siguen siendo de tamano fijo. En nd.cc se instancian
+// 88, 180, 360 y 720 sectores, e InicializarND escoge uno de ellos.
 
-  TSR SR1;                  // Estado actual del robot: posici�n y orientaci�n.
-  TVelocities velocidades; // Estado actual del robot: velocidades lineal y angular.
+template <int SECTORES>
+class NucleoND {
 
-  TCoordenadasPolares d[SECTORES]; // Distancia desde el centro del robot al obst�culo m�s pr�ximo en cada sector (con �ngulos).
-  float dr[SECTORES]; // Distancia desde el per�metro del robot al obst�culo m�s pr�ximo en cada sector.
+  // El numero de sectores debe ser multiplo de 4.
+  typedef char SectoresMultiploDe4[(SECTORES%4==0) ? 1 : -1];
 
-  TVRegiones regiones; // S�lo como informaci�n de cara al exterior: Lista de todas las regiones encontradas en el proceso de selecci�n.
-  int region;          // Como almacenamos m�s de una regi�n debemos indicar cu�l es la escogida.
+public:
 
-  int obstaculo_izquierda,obstaculo_derecha;
+  // Informacion acerca del robot.
 
-  float angulosin;    // S�lo como informaci�n de cara al exterior: �ngulo antes de tener en cuenta los obst�culos m�s pr�ximos.
-  float angulocon;    // S�lo como informaci�n de cara al exterior: �ngulo despu�s de tener en cuenta los obst�culos m�s pr�ximos.
-  char situacion[20]; // S�lo como informaci�n de cara al exterior: Situaci�n en la que se encuentra el robot.
-  char cutting[20];   // S�lo como informaci�n de cara al exterior: Cutting aplicado al movimiento del robot.
+  typedef struct {
 
-  float angulo;    // Salida del algoritmo de navegaci�n y entrada al generador de movimientos: direcci�n de movimiento deseada.
-  float velocidad; // Salida del algoritmo de navegaci�n y entrada al generador de movimientos: velocidad lineal deseada.
+    TDimensiones Dimensiones;
+    float enlarge;
 
-} TInfoND;
+    short int geometriaRect; // Si es cuadrado o no
 
-// ----------------------------------------------------------------------------
-// VARIABLES.
-// ----------------------------------------------------------------------------
+    float R; // radio del robot por si es circular
 
-extern TInfoRobot robot;
+    short int holonomo;
 
-// ----------------------------------------------------------------------------
-// FUNCIONES.
-// ----------------------------------------------------------------------------
+    float E[SECTORES]; // Distancia desde el origen de SR2 al per�metro del robot.
+    float ds[SECTORES];  // Distancia de seguridad: desde el per�metro del robot al per�metro de seguridad.
+
+    float velocidad_lineal_maxima;
+    float velocidad_angular_maxima;
+
+    float aceleracion_lineal_maxima;
+    float aceleracion_angular_maxima;
+
+    float discontinuidad; // Espacio m�nimo por el que cabe el robot.
+
+    float T; // Per�odo.
+
+    TMatriz2x2 H; // Generador de movimientos: "Inercia" del robot.
+    TMatriz2x2 G; // Generador de movimientos: "Fuerza" aplicada sobre el robot.
+
+  } TInfoRobot;
+
+  typedef struct {
+    int longitud;
+    TRegion vector[SECTORES];
+  } TVRegiones;
+
+  // Informaci�n interna del m�todo de navegaci�n.
+
+  typedef struct {
+
+    TObjetivo objetivo;
+
+    TSR SR1;                  // Estado actual del robot: posici�n y orientaci�n.
+    TVelocities velocidades; // Estado actual del robot: velocidades lineal y angular.
+
+    TCoordenadasPolares d[SECTORES]; // Distancia desde el centro del robot al obst�culo m�s pr�ximo en cada sector (con �ngulos).
+    TCoordenadas c[SECTORES]; // El mismo obstaculo que d[] en coordenadas cartesianas (SR1).
+    float dr[SECTORES]; // Distancia desde el per�metro del robot al obst�culo m�s pr�ximo en cada sector.
+
+    TVRegiones regiones; // S�lo como informaci�n de cara al exterior: Lista de todas las regiones encontradas en el proceso de selecci�n.
+    int region;          // Como almacenamos m�s de una regi�n debemos indicar cu�l es la escogida.
+
+    int obstaculo_izquierda,obstaculo_derecha;
+
+    float angulosin;    // S�lo como informaci�n de cara al exterior: �ngulo antes de tener en cuenta los obst�culos m�s pr�ximos.
+    float angulocon;    // S�lo como informaci�n de cara al exterior: �ngulo despu�s de tener en cuenta los obst�culos m�s pr�ximos.
+    TSituacionND situacion; // Situacion en la que se encuentra el robot (NombreSituacionND para el texto).
+    TCuttingND cutting;     // Cutting aplicado al movimiento del robot (NombreCuttingND para el texto).
+
+    float angulo;    // Salida del algoritmo de navegaci�n y entrada al generador de movimientos: direcci�n de movimiento deseada.
+    float velocidad; // Salida del algoritmo de navegaci�n y entrada al generador de movimientos: velocidad lineal deseada.
+
+  } TInfoND;
+
+  static TInfoRobot robot;
+
+  static float sector2angulo(int sector);
+
+  static int angulo2sector(float angulo);
+
+  static void InicializarND(TParametersND *parametros);
+
+  static TVelocities *IterarND(TCoordenadas objetivo,
+                               float goal_tol,
+                               TInfoMovimiento *movimiento,
+                               TInfoEntorno *mapa,
+                               void *informacion);
+
+  static int EvaluarObjetivos(TObjetivoND *objetivos,int n,
+                              TInfoMovimiento *movimiento,
+                              TInfoEntorno *mapa,
+                              int hilos);
+
+private:
+
+  static TInfoND info;
+
+  static void Diagnosticar(const TInfoND &nd,void *informacion);
+
+  // Reparto de EvaluarObjetivos entre hilos: cada uno trabaja sobre su
+  // propia copia de la informacion sectorizada.
+  typedef struct {
+    TInfoND *nd;
+    TObjetivoND *objetivos;
+    int n;
+    int primero;
+    int paso;
+  } TTrabajoObjetivos;
+
+  static void EvaluarObjetivo(TInfoND *nd,TObjetivoND *objetivo);
+  static void *EvaluarObjetivosHilo(void *trabajo);
+
+  static int ObtenerSectorP(TCoordenadasPolares p);
+  static int DistanciaSectorialOrientada(int s1,int s2);
+
+  static void InicializarE(void);
+  static void InicializarERedondo(void);
+  static void InicializarDSRedondo(float dmax);
+  static void InicializarDS(float dsmax,float dsmin);
+
+  static void SectorizarMapa(TInfoEntorno *mapa,TInfoND *nd);
+  static int ParadaEmergencia(TInfoND *nd);
+  static void SiguienteDiscontinuidad(TInfoND *nd,int principio,int izquierda,int *discontinuidad,int *ascendente);
+  static int ObjetivoAlcanzable(TInfoND *nd,TRegion *region,int direccion_tipo);
+  static void SeleccionarRegion(TInfoND *nd);
+  static void ConstruirDR(TInfoND *nd);
+  static void ObtenerObstaculos(TInfoND *nd,float beta);
+
+  static float solHSGR(TInfoND *nd);
+  static float solHSNR(TInfoND *nd);
+  static float solHSWR(TInfoND *nd);
+  static float solLS1(TInfoND *nd);
+  static float solLSG(TInfoND *nd);
+  static float solLS2(TInfoND *nd);
+  static void control_angulo(TInfoND *nd);
+  static void control_velocidad(TInfoND *nd);
+
+  static void GenerarMovimientoFicticio(TInfoND *nd,float angulo,TVelocities *velocidades);
+  static void GiroBrusco(TInfoND *nd,TVelocities *velocidades);
+  static int ObtenerSituacionCutting(TInfoND *nd,float w);
+  static float AnguloSinRotacion(TInfoND *nd,TVelocities *velocidades);
+  static void Cutting(TInfoND *nd, TVelocities *velocidades);
+};
 
-extern float sector2angulo(int sector);
+// Numero de sectores del nucleo escogido por el ultimo InicializarND.
+// El parametro "informacion" de IterarND apunta a un NucleoND<N>::TInfoND
+// con este N.
 
-extern int angulo2sector(float angulo);
+extern int SectoresND(void);
 
 
 #endif 
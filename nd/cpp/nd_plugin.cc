@@ -145,6 +145,47 @@ underlying "output" @ref interface_position2d device.
     to give returns from the robot's body (usually the wheels), or if they
     are just not needed because of overlap with the laser.
 
+- sectors (integer)
+  - Default: 180
+  - Number of sectors of the nearness diagram: 88, 180, 360 or 720.  More
+    sectors make use of the resolution of fine lidars at a higher cost
+    per cycle; fewer sectors suit slow processors.
+
+- min_period (float)
+  - Default: 0.0 seconds
+  - Minimum time between two ND cycles.  The driver runs one cycle for
+    each new laser or sonar scan, so this only limits the command rate
+    when the sensors publish faster than needed.
+
+- max_odom_wait (float)
+  - Default: 0.1 seconds
+  - How long a new scan may wait for an odometry update before the cycle
+    is run with the last known pose.
+
+- metrics_file (string)
+  - Default: none
+  - If given, the driver profiles every ND iteration (time spent in each
+    phase of the algorithm, situations and cutting corrections selected,
+    scan to command latency) and periodically rewrites this file with
+    the accumulated figures, one "key value" entry per line.
+
+- metrics_period (float)
+  - Default: 1.0 seconds
+  - How often metrics_file is rewritten.
+
+- obstacle_cell_size (length)
+  - Default: 0.0 m
+  - If positive, the buffered laser and sonar points are decimated before
+    being handed to ND: the area around the robot is split into square
+    cells of this size and only the point nearest to the robot is kept in
+    each cell.  A few centimetres is enough to remove the duplicates
+    produced by consecutive scans of the same walls.
+
+- obstacle_grid_radius (length)
+  - Default: 8.0 m
+  - Half side of the decimation grid centred on the robot.  Points
+    farther away than this are passed through untouched.
+
 @par Example
 
 @verbatim
@@ -181,10 +222,13 @@ driver
   #include <unistd.h>
 #endif
 #include <stdlib.h>
+#include <stdio.h>
 #include <float.h>
+#include <limits.h>
 
 #include <libplayercore/playercore.h>
 #include "nd.h"
+#include "obstacle_grid.h"
 
 #include "clock.h"
 
@@ -226,6 +270,7 @@ class ND : public ThreadedDriver
     bool odom_stall;
     int current_dir;
     TParametersND NDparametros;
+    int sectors;
 
     double rotate_start_time;
     double rotate_min_error;
@@ -250,6 +295,11 @@ class ND : public ThreadedDriver
     TInfoEntorno* sonar_obstacles;
     int num_sonar_scans;
 
+    // Decimation of the merged obstacle list (disabled if cell size is 0)
+    double obstacle_cell_size;
+    double obstacle_grid_radius;
+    TObstacleGrid obstacle_grid;
+
     double vx_max, va_max;
     double vx_min, va_min;
     double avoid_dist;
@@ -271,6 +321,10 @@ class ND : public ThreadedDriver
     void ProcessSonar(player_msghdr_t* hdr, player_sonar_data_t* data);
     void ProcessCommand(player_msghdr_t* hdr, player_position2d_cmd_vel_t* cmd);
     void ProcessCommand(player_msghdr_t* hdr, player_position2d_cmd_pos_t* cmd);
+    // Mark that a new scan is waiting for an ND cycle
+    void ScanArrived();
+    // Tell whether an ND cycle is due; if not, how long to wait for one
+    bool CycleDue(double* timeout);
     // Send a command to the motors
     void PutPositionCmd(double vx, double va);
 
@@ -301,8 +355,24 @@ class ND : public ThreadedDriver
     int bad_sonar_count;
     int sonar_buffer;
 
+    // Cycle scheduling: one ND cycle per new scan
+    double min_period;
+    double max_odom_wait;
+    bool have_odom;
+    bool odom_fresh;
+    bool scan_pending;
+    double scan_time;
+    double last_cycle_time;
+
     // Performance data.
     stat_t statistics;
+    lat_t latency;
+    TMetricasND metrics;
+    const char* metrics_file;
+    double metrics_period;
+    double metrics_time;
+    void DumpMetrics(FILE* file);
+    void WriteMetricsFile();
 };
 
 // Initialization function
@@ -344,6 +414,11 @@ ND::ND( ConfigFile* cf, int section)
                                                DTOR(20.0));
   this->wait_on_stall =
           cf->ReadInt(section, "wait_on_stall", 0) ?  true : false;
+  this->sectors = cf->ReadInt(section, "sectors", 180);
+  this->min_period = cf->ReadFloat(section, "min_period", 0.0);
+  this->max_odom_wait = cf->ReadFloat(section, "max_odom_wait", 0.1);
+  this->metrics_file = cf->ReadString(section, "metrics_file", NULL);
+  this->metrics_period = cf->ReadFloat(section, "metrics_period", 1.0);
 
   this->odom = NULL;
   if (cf->ReadDeviceAddr(&this->odom_addr, section, "requires",
@@ -389,6 +464,11 @@ ND::ND( ConfigFile* cf, int section)
     this->sonar_buffer = cf->ReadInt(section, "sonar_buffer", 20);
   }
 
+  this->obstacle_cell_size = cf->ReadLength(section, "obstacle_cell_size", 0.0);
+  this->obstacle_grid_radius = cf->ReadLength(section, "obstacle_grid_radius",
+                                              8.0);
+  memset(&this->obstacle_grid, 0, sizeof(TObstacleGrid));
+
   if(!this->laser_addr.interf && !this->sonar_addr.interf)
   {
     PLAYER_ERROR("ND needs at least one sonar or one laser");
@@ -430,6 +510,14 @@ int ND::MainSetup()
   }
 
   this->obstacles.longitud = 0;
+  if(this->obstacle_cell_size > 0.0 &&
+     ObstacleGridInit(&this->obstacle_grid,
+                      static_cast<float> (this->obstacle_cell_size),
+                      static_cast<float> (this->obstacle_grid_radius)) != 0)
+  {
+    PLAYER_ERROR("unable to allocate the obstacle grid");
+    return -1;
+  }
   this->stall = false;
   this->turning_in_place = false;
   this->last_odom_pose.px =
@@ -438,7 +526,15 @@ int ND::MainSetup()
 
   this->waiting = false;
 
+  this->have_odom = false;
+  this->odom_fresh = false;
+  this->scan_pending = false;
+  this->last_cycle_time = 0.0;
+
   statReset(&this->statistics);
+  latReset(&this->latency);
+  memset(&this->metrics, 0, sizeof(this->metrics));
+  this->metrics_time = clockNow();
 
   return 0;
 }
@@ -457,6 +553,39 @@ void ND::MainQuit()
 
   // Stop the odom device.
   this->ShutdownOdom();
+
+  ObstacleGridFree(&this->obstacle_grid);
+
+  MetricasND(NULL);
+  if(this->metrics_file)
+    this->WriteMetricsFile();
+}
+
+void
+ND::DumpMetrics(FILE* file)
+{
+  ImprimirMetricasND(file, &this->metrics);
+  fprintf(file, "latencia %u %.9f %.9f %.9f\n", this->latency.count,
+          this->latency.count ? this->latency.total / this->latency.count : 0.0,
+          this->latency.min, this->latency.max);
+}
+
+void
+ND::WriteMetricsFile()
+{
+  // Write a temporary file and rename it, so that readers never see a
+  // partial dump
+  char tmp[PATH_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", this->metrics_file);
+  FILE* file = fopen(tmp, "w");
+  if(!file)
+  {
+    PLAYER_WARN1("unable to write metrics to %s", tmp);
+    return;
+  }
+  this->DumpMetrics(file);
+  fclose(file);
+  rename(tmp, this->metrics_file);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -664,6 +793,8 @@ void
 ND::ProcessInputOdom(player_msghdr_t* hdr, player_position2d_data_t* data)
 {
   this->odom_pose = data->pos;
+  this->have_odom = true;
+  this->odom_fresh = true;
 
   player_msghdr_t newhdr = *hdr;
   newhdr.addr = this->device_addr;
@@ -716,6 +847,8 @@ ND::ProcessLaser(player_msghdr_t* hdr, player_laser_data_t* scan)
 
   db = scan->resolution;
 
+  this->ScanArrived();
+
   // Is the scan buffer full?
   if(this->num_laser_scans == this->laser_buffer)
   {
@@ -769,6 +902,8 @@ ND::ProcessSonar(player_msghdr_t* hdr, player_sonar_data_t* scan)
   int count = 0;
   int idx;
 
+  this->ScanArrived();
+
   // Is the scan buffer full?
   if(this->num_sonar_scans == this->sonar_buffer)
   {
@@ -822,6 +957,54 @@ ND::ProcessSonar(player_msghdr_t* hdr, player_sonar_data_t* scan)
   this->sonar_obstacles[idx].longitud = count;
 }
 
+void
+ND::ScanArrived()
+{
+  // Keep the arrival time of the oldest scan not yet used by ND, so the
+  // latency we report is the worst one.
+  if(!this->scan_pending)
+  {
+    this->scan_time = clockNow();
+    this->scan_pending = true;
+  }
+}
+
+bool
+ND::CycleDue(double* timeout)
+{
+  double now, left;
+
+  // Block until the next message
+  *timeout = 0.0;
+
+  if(!this->scan_pending || !this->have_odom)
+    return false;
+
+  now = clockNow();
+
+  // Give the odometry a chance to catch up with the scan
+  if(!this->odom_fresh)
+  {
+    left = this->max_odom_wait - (now - this->scan_time);
+    if(left > 0.0)
+    {
+      *timeout = left;
+      return false;
+    }
+  }
+
+  // Do not run faster than requested
+  left = this->min_period - (now - this->last_cycle_time);
+  if(left > 0.0)
+  {
+    *timeout = left;
+    return false;
+  }
+
+  this->last_cycle_time = now;
+  return true;
+}
+
 void
 ND::ProcessCommand(player_msghdr_t* hdr, player_position2d_cmd_vel_t* cmd)
 {
@@ -1002,6 +1185,7 @@ ND::Main()
   TInfoMovimiento pose;
   double g_dx, g_da;
   double vx, va;
+  double timeout = 0.0;
 
   // Fill in the ND's parameter structure
 
@@ -1033,14 +1217,21 @@ ND::Main()
 
   this->NDparametros.T = 0.1F;  // Sample rate of the SICK
 
+  this->NDparametros.sectors = this->sectors;
+
   // Pass the structure to ND for initialization
   InicializarND(&this->NDparametros);
 
+  // Profile the ND iterations into our metrics block
+  MetricasND(&this->metrics);
+
   this->current_dir = 1;
 
   for(;;)
   {
-    usleep(20000);
+    // Sleep until new messages arrive (or until a deferred cycle is due)
+    this->Wait(timeout);
+    timeout = 0.0;
 
     pthread_testcancel();
 
@@ -1054,7 +1245,23 @@ ND::Main()
 
     // do we have a goal?
     if(!this->active_goal)
+    {
+      this->scan_pending = false;
       continue;
+    }
+
+    // Run once per new scan
+    if(!this->CycleDue(&timeout))
+      continue;
+    this->scan_pending = false;
+    this->odom_fresh = false;
+
+    if(this->metrics_file &&
+       this->last_cycle_time - this->metrics_time >= this->metrics_period)
+    {
+      this->WriteMetricsFile();
+      this->metrics_time = this->last_cycle_time;
+    }
 
     // The robot's current odometric pose
     pose.SR1.posicion.x = static_cast<float> (this->odom_pose.px);
@@ -1062,19 +1269,39 @@ ND::Main()
     pose.SR1.orientacion = static_cast<float> (this->odom_pose.pa);
 
     // Merge the (possibly buffered) laser and sonar obstacle lists
-    this->obstacles.longitud = 0;
-    for(int i=0;i<this->num_laser_scans;i++) {
-      memcpy(this->obstacles.punto + this->obstacles.longitud,
-             this->laser_obstacles[i].punto,
-             this->laser_obstacles[i].longitud * sizeof(TCoordenadas));
-      this->obstacles.longitud += this->laser_obstacles[i].longitud;
+    if(this->obstacle_cell_size > 0.0)
+    {
+      // Keep only the nearest point per grid cell around the robot
+      ObstacleGridBegin(&this->obstacle_grid,
+                        pose.SR1.posicion.x, pose.SR1.posicion.y,
+                        &this->obstacles);
+      for(int i=0;i<this->num_laser_scans;i++)
+        ObstacleGridAdd(&this->obstacle_grid,
+                        this->laser_obstacles[i].punto,
+                        this->laser_obstacles[i].longitud,
+                        &this->obstacles);
+      for(int i=0;i<this->num_sonar_scans;i++)
+        ObstacleGridAdd(&this->obstacle_grid,
+                        this->sonar_obstacles[i].punto,
+                        this->sonar_obstacles[i].longitud,
+                        &this->obstacles);
     }
-    for(int i=0;i<this->num_sonar_scans;i++)
+    else
     {
-      memcpy(this->obstacles.punto + this->obstacles.longitud,
-             this->sonar_obstacles[i].punto,
-             this->sonar_obstacles[i].longitud * sizeof(TCoordenadas));
-      this->obstacles.longitud += this->sonar_obstacles[i].longitud;
+      this->obstacles.longitud = 0;
+      for(int i=0;i<this->num_laser_scans;i++) {
+        memcpy(this->obstacles.punto + this->obstacles.longitud,
+               this->laser_obstacles[i].punto,
+               this->laser_obstacles[i].longitud * sizeof(TCoordenadas));
+        this->obstacles.longitud += this->laser_obstacles[i].longitud;
+      }
+      for(int i=0;i<this->num_sonar_scans;i++)
+      {
+        memcpy(this->obstacles.punto + this->obstacles.longitud,
+               this->sonar_obstacles[i].punto,
+               this->sonar_obstacles[i].longitud * sizeof(TCoordenadas));
+        this->obstacles.longitud += this->sonar_obstacles[i].longitud;
+      }
     }
     // TODO: put a smarter check earlier
     assert(this->obstacles.longitud <= MAX_POINTS_SCENARIO);
@@ -1092,7 +1319,10 @@ ND::Main()
       PLAYER_MSG0(1, "At goal");
       // Print statistics.
       statPrint(&this->statistics);
+      latPrint(&this->latency, "scan to command");
+      this->DumpMetrics(stdout);
       statReset(&this->statistics);
+      latReset(&this->latency);
       exit(0);
       continue;
     }
@@ -1260,6 +1490,7 @@ ND::Main()
           vx = -vx;
         }
         this->PutPositionCmd(vx, va);
+        latAdd(&this->latency, clockNow() - this->scan_time);
       }
     }
   }
@@ -0,0 +1,107 @@
+/*
+ *  Obstacle point decimation for the ND driver.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obstacle_grid.h"
+
+int ObstacleGridInit(TObstacleGrid *grid, float cell, float radius)
+{
+  int cells;
+
+  memset(grid, 0, sizeof(TObstacleGrid));
+  if (cell <= 0.0F || radius <= 0.0F)
+    return -1;
+
+  grid->cell = cell;
+  grid->half = (int)ceilf(radius / cell);
+  grid->side = 2 * grid->half + 1;
+
+  cells = grid->side * grid->side;
+  grid->stamp = (unsigned int*)calloc(cells, sizeof(unsigned int));
+  grid->index = (int*)malloc(cells * sizeof(int));
+  grid->dist2 = (float*)malloc(cells * sizeof(float));
+  if (!grid->stamp || !grid->index || !grid->dist2) {
+    ObstacleGridFree(grid);
+    return -1;
+  }
+  return 0;
+}
+
+void ObstacleGridFree(TObstacleGrid *grid)
+{
+  free(grid->stamp);
+  free(grid->index);
+  free(grid->dist2);
+  grid->stamp = NULL;
+  grid->index = NULL;
+  grid->dist2 = NULL;
+}
+
+void ObstacleGridBegin(TObstacleGrid *grid, float cx, float cy,
+                       TInfoEntorno *out)
+{
+  grid->cx = cx;
+  grid->cy = cy;
+  out->longitud = 0;
+
+  // Stamps are compared for equality, so on wrap-around the old ones must
+  // be wiped or they could alias the new generation.
+  if (++grid->generation == 0) {
+    memset(grid->stamp, 0, grid->side * grid->side * sizeof(unsigned int));
+    grid->generation = 1;
+  }
+}
+
+void ObstacleGridAdd(TObstacleGrid *grid, const TCoordenadas *points, int n,
+                     TInfoEntorno *out)
+{
+  const float inv = 1.0F / grid->cell;
+  const int half = grid->half;
+  const int side = grid->side;
+  int i, ix, iy, c;
+  float dx, dy, d2;
+
+  for (i = 0; i < n; i++) {
+    dx = points[i].x - grid->cx;
+    dy = points[i].y - grid->cy;
+    ix = (int)floorf(dx * inv + 0.5F) + half;
+    iy = (int)floorf(dy * inv + 0.5F) + half;
+
+    if (ix < 0 || ix >= side || iy < 0 || iy >= side) {
+      // Out of the grid: keep it untouched
+      if (out->longitud < MAX_POINTS_SCENARIO)
+        out->punto[out->longitud++] = points[i];
+      continue;
+    }
+
+    d2 = dx * dx + dy * dy;
+    c = iy * side + ix;
+    if (grid->stamp[c] != grid->generation) {
+      if (out->longitud >= MAX_POINTS_SCENARIO)
+        continue;
+      grid->stamp[c] = grid->generation;
+      grid->index[c] = out->longitud;
+      grid->dist2[c] = d2;
+      out->punto[out->longitud++] = points[i];
+    }
+    else if (d2 < grid->dist2[c]) {
+      // Nearer to the robot: replace the point kept for this cell in place
+      grid->dist2[c] = d2;
+      out->punto[grid->index[c]] = points[i];
+    }
+  }
+}
@@ -0,0 +1,53 @@
+/*
+ *  Obstacle point decimation for the ND driver.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+// A fixed-size square grid of cells centred on the robot.  Buffered laser
+// and sonar points are dropped into it and only the point nearest to the
+// robot survives in each cell, which removes the near-duplicates produced by
+// consecutive scans of the same walls.  Cells are never cleared: each one
+// carries the generation in which it was last written, so starting a new
+// merge is O(1).  Points falling outside the grid are passed through as is.
+
+#ifndef obstacle_grid_h
+#define obstacle_grid_h
+
+#include "nd.h"
+
+typedef struct {
+  float cell;          // cell side (m)
+  int half;            // cells between the centre cell and the border
+  int side;            // 2*half+1
+  float cx, cy;        // centre of the grid for the current merge
+  unsigned int generation;
+  unsigned int *stamp; // generation in which each cell was last written
+  int *index;          // index in the output list of the point kept
+  float *dist2;        // squared distance from the centre of that point
+} TObstacleGrid;
+
+// Allocates a grid covering a square of 2*radius around the robot.
+// Returns 0 on success, -1 on bad arguments or allocation failure.
+int ObstacleGridInit(TObstacleGrid *grid, float cell, float radius);
+
+void ObstacleGridFree(TObstacleGrid *grid);
+
+// Starts a new merge around (cx,cy).  The output list is emptied.
+void ObstacleGridBegin(TObstacleGrid *grid, float cx, float cy,
+                       TInfoEntorno *out);
+
+// Adds a batch of points (one laser or sonar scan) to the current merge.
+// Points beyond MAX_POINTS_SCENARIO are discarded.
+void ObstacleGridAdd(TObstacleGrid *grid, const TCoordenadas *points, int n,
+                     TInfoEntorno *out);
+
+#endif
@@ -22,6 +22,10 @@
 /* Perhaps better and more precise with more sectors, but never test with other value */
 #define NDD_NSECTORS 144
 
+/* internal parameter: max depth of the split in nddExtractSegments, */
+/* deeper ranges are kept as one segment */
+#define NDD_SPLIT_STACK 64
+
 /* dinamycally changeable parameters*/
 
 /* data flow connexions */
@@ -1,6 +1,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "nddLib.h"
 #include "nddLibPrivate.h"
@@ -13,14 +14,21 @@ static float nddEstimateValleyWidth(int s1, int s2, NDD_DIAGRAM * diag,
 
 float * nddComputeEnlargement(int nSect, float lmaxRobot, float secuDist,
  			      float vmaxRobot, float timeStep) { 
-   int i;  
    float * e;  
+     
+   e = (float *) malloc (nSect*sizeof(float)); 
+   if (e != NULL)
+     nddFillEnlargement(e, nSect, lmaxRobot, secuDist, vmaxRobot, timeStep);
+   return e;    
+ } 
+
+void nddFillEnlargement(float * e, int nSect, float lmaxRobot, float secuDist,
+			float vmaxRobot, float timeStep) {
+   int i;  
    double alpha; 
    float enlargement; 
    float sectSize = 2.0 * M_PI / (float) nSect; 
    double ensd;;
-     
-   e = (float *) malloc (nSect*sizeof(float)); 
   
    for (i=0; i<nSect; i++) 
      e[i] = lmaxRobot*0.75; 
@@ -35,7 +43,6 @@ float * nddComputeEnlargement(int nSect, float lmaxRobot, float secuDist,
      /*      e[i] = vmaxRobot*timeStep + lmaxRobot; */
      e[nSect-i-1] = e[i]; 
    } 
-   return e;    
  } 
 
 
@@ -54,25 +61,19 @@ static int nddIsWideValley (NDD_VALLEY * v, int nsectors,int smax) {
 }
 
 
-static int nddFillPndFromPoints(NDD_DIAGRAM * diag, NDD_POINT * points, int n_pt,
-			 double distMax) {
+static int nddFillPndFromPoints(NDD_DIAGRAM * diag, nddSectorAcc * acc,
+			 NDD_POINT * points, int n_pt, double distMax) {
 /*see IROS 2000 for an exhaustive explanation*/ 
-/*   this list will contains all points in rho, theta, */
-/*     next we compute the average for each sector, then we fill pnd */
-  nddFloatList ** list_of_rho;
+/*   each point in rho, theta is accumulated in its sector, */
+/*     next we compute the estimate for each sector, then we fill pnd */
   int i, sector;
   int nsectors = diag->nsectors;
   double angle;
   double dist;
-  nddFloatList * new_f;
   
-  list_of_rho = (nddFloatList **) malloc 
-    (nsectors * sizeof(nddFloatList*));
-  
-  for (i=0; i<nsectors; i++)
-    list_of_rho[i] = NULL;
+  nddSectorAccReset(acc, nsectors);
 
-  /*for each cartesian point, fill our rho_list*/
+  /*for each cartesian point, fill our accumulators*/
   for (i=0; i<n_pt; i++) {
     if ( (points[i].x != 0.0) && (points[i].y != 0.0) ) { 
       angle = atan2(points[i].y, points[i].x);
@@ -81,17 +82,14 @@ static int nddFillPndFromPoints(NDD_DIAGRAM * diag, NDD_POINT * points, int n_pt
 	continue;
       sector = (int) ((double)angle  * (double)nsectors / 2.0 / M_PI);
       if (sector < 0) sector += nsectors;
+      else if (sector >= nsectors) sector -= nsectors;
       
-      new_f = (nddFloatList *) malloc (sizeof(nddFloatList));
-      new_f->next = list_of_rho[sector];
-      new_f->v = dist;
-      list_of_rho[sector] = new_f;
+      nddSectorAccAdd(&acc[sector], dist);
     }
   }
   
   for (i=0; i<nsectors; i++) {
-    dist = nddEstimateDistToObstFromValues(list_of_rho[i]);
-    nddFloatListFree(list_of_rho[i]);
+    dist = nddEstimateDistToObstFromAcc(&acc[i]);
     if (dist == NDDLIB_PND_OCCUPIED)
       diag->pnd[i] = NDDLIB_PND_OCCUPIED;
     else if (dist >= diag->dmax_sensor) 
@@ -106,82 +104,46 @@ static int nddFillPndFromPoints(NDD_DIAGRAM * diag, NDD_POINT * points, int n_pt
       diag->pnd[i] = diag->dmax_sensor + diag->lmax_robot - dist;
     
   }
-  
-  free(list_of_rho);
 
   return nsectors;
 }
 
-static int nddFillPndFromSegments(NDD_DIAGRAM * diag, NDD_SEGMENT * segments, 
-			   int n_segs, NDD_POINT * lonelyPoints, int n_lPoints) {
+static int nddFillPndFromSegments(NDD_DIAGRAM * diag, nddSectorAcc * acc,
+			   NDD_SEGMENT * segments, int n_segs, double distMax,
+			   NDD_POINT * lonelyPoints, int n_lPoints) {
 /*see IROS 2000 for an exhaustive explanation*/ 
-/*   this list will contains all points in rho, theta, */
-/*     next we compute the average for each sector, then we fill pnd */
+/*   each segment is rasterised into the sectors it spans (nearest */
+/*     distance in each one), the lonely points are accumulated in their */
+/*     sector, next we compute the estimate for each sector, then we fill pnd */
 
-  nddFloatList ** list_of_rho;
-  int i,j , sector1, sector2;
+  int i, sector1;
   int nsectors = diag->nsectors;
-  int dum;
   double dist;
   double  angle;
-  nddFloatList * new_f;
   
-  list_of_rho = (nddFloatList **) malloc 
-    (nsectors * sizeof(nddFloatList*));
-  
-  for (i=0; i<nsectors; i++) list_of_rho[i] = NULL;
+  nddSectorAccReset(acc, nsectors);
 
-  /*for each polar point, fill our rho_list*/
+  /*for each polar segment, fill our accumulators*/
   for (i=0; i<n_segs; i++) {
-    
-    sector1 = (int) (segments[i].t1  * (double)nsectors / 2.0 / M_PI);
-    if (sector1 < 0)  sector1 += nsectors;
-    else if (sector1 >=nsectors) sector1 -= nsectors;
-    sector2 = (int) (segments[i].t2  * (double)nsectors / 2.0 / M_PI);
-    if (sector2 < 0) sector2 += nsectors;
-    else if (sector2 >=nsectors) sector2 -= nsectors;
-
-    new_f = (nddFloatList *) malloc (sizeof(nddFloatList));
-    new_f->next = list_of_rho[sector1];
-    new_f->v = segments[i].r1;
-    list_of_rho[sector1] = new_f;  
-    new_f = (nddFloatList *) malloc (sizeof(nddFloatList));
-    new_f->next = list_of_rho[sector2];
-    new_f->v = segments[i].r2;
-    list_of_rho[sector2] = new_f;  
-
-    dum = sector2 - sector1;
-    if (dum < 0) dum += nsectors;
-    if (dum > 1) {
-      j = sector1 + 1;    
-      if (j >= nsectors) j -= nsectors;
-      while (j != sector2) {
-	new_f = (nddFloatList *) malloc (sizeof(nddFloatList));
-	new_f->next = list_of_rho[j];
-	new_f->v = NDDLIB_PND_OCCUPIED;
-	list_of_rho[j++] = new_f;              
-	if (j >= nsectors) j -= nsectors;
-      }
-    }
+    /* segments farther than distMax are ignored */
+    if (nddDistToSeg(&(segments[i])) > distMax)
+      continue;
+    nddSectorAccAddSegment(acc, nsectors, &(segments[i]));
   }
 
   for (i=0; i<n_lPoints; i++) {     
     angle = atan2(lonelyPoints[i].y, lonelyPoints[i].x); 
     dist = sqrt (lonelyPoints[i].y * lonelyPoints[i].y +
 		 lonelyPoints[i].x * lonelyPoints[i].x);
-    sector1 = (int) ((double)angle  * (double)nsectors / 2.0 / M_PI);     
+    sector1 = (int) floor((double)angle  * (double)nsectors / 2.0 / M_PI);
     if (sector1 < 0) sector1 += nsectors; 
     if (sector1 >= nsectors) sector1 -= nsectors;
 
-    new_f = (nddFloatList *) malloc (sizeof(nddFloatList)); 
-    new_f->next = list_of_rho[sector1]; 
-    new_f->v = dist; 
-    list_of_rho[sector1] = new_f;   
+    nddSectorAccAdd(&acc[sector1], dist);
    } 
   
   for (i=0; i<nsectors; i++) {
-    dist = nddEstimateDistToObstFromValues(list_of_rho[i]);
-    nddFloatListFree(list_of_rho[i]);
+    dist = nddEstimateDistToObstFromAcc(&acc[i]);
     if (dist == NDDLIB_PND_OCCUPIED)
       diag->pnd[i] = NDDLIB_PND_OCCUPIED;
     else if (dist >= diag->dmax_sensor) 
@@ -195,8 +157,6 @@ static int nddFillPndFromSegments(NDD_DIAGRAM * diag, NDD_SEGMENT * segments,
     else 
       diag->pnd[i] = diag->dmax_sensor + diag->lmax_robot - dist;
   }
-  
-  free(list_of_rho);
 
   return nsectors;
 }
@@ -965,7 +925,8 @@ static int nddChooseStrategy(NDD_DIAGRAM * diag, NDD_POINT * goal,
  */
 
 static int nddComputeRefGeneral( int fromPoints,
-			  NDD_DIAGRAM * diag, NDD_POINT * points, 
+			  NDD_DIAGRAM * diag, nddSectorAcc * acc,
+			  NDD_POINT * points, 
 			  int n_pt, 
 			  NDD_SEGMENT * segments,	
 			  int n_segs, 
@@ -986,11 +947,9 @@ static int nddComputeRefGeneral( int fromPoints,
   int res=1; /* 1 or 0 */
 
   if (fromPoints)
-    nddFillPndFromPoints(diag, points, n_pt, 
+    nddFillPndFromPoints(diag, acc, points, n_pt, 
 			 sqrt(loc_goal->x*loc_goal->x+loc_goal->y*loc_goal->y));
   else {
-    NDD_SEGMENT * newSegs;
-    int newNSegs;
     float dist_to_goal;
     float dmax;
     dist_to_goal = sqrt (loc_goal->x * loc_goal->x  
@@ -999,9 +958,8 @@ static int nddComputeRefGeneral( int fromPoints,
       dmax = dist_to_goal+diag->lmax_robot/2.0;
     else
       dmax = dMaxLocalMap;
-    newSegs = nddFiltrateSegments(segments, n_segs, dmax, &newNSegs);
-    nddFillPndFromSegments(diag, newSegs, newNSegs, lonelyPoints, n_lPoints);
-    free (newSegs);
+    nddFillPndFromSegments(diag, acc, segments, n_segs, dmax,
+			   lonelyPoints, n_lPoints);
   }
 
   nddFillRnd(diag, enlargement);
@@ -1131,8 +1089,9 @@ int nddComputeRefFromPoints(NDD_DIAGRAM * diag, NDD_POINT * points,
 			    double wmax, 				 
 			    double *thetaRef,
 			    NDD_SPEED_REF * sr, int linFactor) {
+  nddSectorAcc acc[NDD_NSECTORS];
   
-  return nddComputeRefGeneral( 1,  diag, points, n_pt, 
+  return nddComputeRefGeneral( 1,  diag, acc, points, n_pt, 
 			       NULL, 0, NULL, 0, dMaxLocalMap,
 			       enlargement, security_distance, loc_goal,
 			       smax, vmax, wmax, thetaRef, sr, linFactor);   
@@ -1158,9 +1117,10 @@ int nddComputeRefFromSegments(NDD_DIAGRAM * diag,
 			      double wmax,
 			      double *thetaRef,
 			      NDD_SPEED_REF *sr, int linFactor) {
+  nddSectorAcc acc[NDD_NSECTORS];
 
   return  nddComputeRefGeneral( 0,
-				diag, NULL, 0,
+				diag, acc, NULL, 0,
 				segments, n_segs, 
 				lonelyPoints, n_lPoints,
 				dMaxLocalMap,				    
@@ -1169,3 +1129,196 @@ int nddComputeRefFromSegments(NDD_DIAGRAM * diag,
 }
 
 
+/* ----------------------------------------------------------------------
+ * nddContextInit
+ *
+ * return 1 if everything was OK or 0 in case of pb
+ */
+int nddContextInit(NDD_CONTEXT * ctx,
+		   float dmaxSensor,
+		   float lmaxRobot,
+		   double security_distance,
+		   double dMaxLocalMap,
+		   double smax,
+		   double vmax,
+		   double wmax,
+		   int linFactor,
+		   float timeStep) {
+  if (lmaxRobot <= 0.0 || dmaxSensor <= 0.0)
+    return 0;
+
+  memset(&ctx->diag, 0, sizeof(NDD_DIAGRAM));
+  ctx->diag.dmax_sensor = dmaxSensor;
+  ctx->diag.lmax_robot = lmaxRobot;
+  ctx->diag.nsectors = NDD_NSECTORS;
+
+  nddFillEnlargement(ctx->enlargement, NDD_NSECTORS, lmaxRobot,
+		     security_distance, vmax, timeStep);
+
+  ctx->dMaxLocalMap = dMaxLocalMap;
+  ctx->security_distance = security_distance;
+  ctx->smax = smax;
+  ctx->vmax = vmax;
+  ctx->wmax = wmax;
+  ctx->linFactor = linFactor;
+  return 1;
+}
+
+
+/* ----------------------------------------------------------------------
+ * nddContextComputeRefFromPoints
+ *
+ * return 1 if everything was OK or 0 in case of pb
+ */
+int nddContextComputeRefFromPoints(NDD_CONTEXT * ctx,
+				   NDD_POINT * points,
+				   int n_pt,
+				   NDD_POINT * loc_goal,
+				   double *thetaRef,
+				   NDD_SPEED_REF *sr) {
+
+  return nddComputeRefGeneral( 1, &ctx->diag, ctx->acc, points, n_pt,
+			       NULL, 0, NULL, 0, ctx->dMaxLocalMap,
+			       ctx->enlargement, ctx->security_distance, loc_goal,
+			       ctx->smax, ctx->vmax, ctx->wmax, thetaRef, sr,
+			       ctx->linFactor);
+}
+
+
+/* ----------------------------------------------------------------------
+ * nddContextComputeRefFromSegments
+ *
+ * return 1 if everything was OK or 0 in case of pb
+ */
+int nddContextComputeRefFromSegments(NDD_CONTEXT * ctx,
+				     NDD_SEGMENT * segments,
+				     int n_segs,
+				     NDD_POINT * lonelyPoints,
+				     int n_lPoints,
+				     NDD_POINT * loc_goal,
+				     double *thetaRef,
+				     NDD_SPEED_REF *sr) {
+
+  return nddComputeRefGeneral( 0, &ctx->diag, ctx->acc, NULL, 0,
+			       segments, n_segs, lonelyPoints, n_lPoints,
+			       ctx->dMaxLocalMap,
+			       ctx->enlargement, ctx->security_distance, loc_goal,
+			       ctx->smax, ctx->vmax, ctx->wmax, thetaRef, sr,
+			       ctx->linFactor);
+}
+
+
+/* ----------------------------------------------------------------------
+ * nddExtractSegments
+ */
+
+/* index of the point of ]first,last[ farthest from the chord first-last,
+   and its distance in dev */
+static int nddFarthestFromChord(NDD_POINT * points, int first, int last,
+				double * dev) {
+  double dx = points[last].x - points[first].x;
+  double dy = points[last].y - points[first].y;
+  double len = sqrt(dx*dx + dy*dy);
+  double d, dmax = 0.0;
+  int i, imax = first;
+
+  for (i=first+1; i<last; i++) {
+    if (len > 0.0)
+      d = fabs(dx * (points[i].y - points[first].y)
+	       - dy * (points[i].x - points[first].x)) / len;
+    else
+      d = hypot(points[i].x - points[first].x, points[i].y - points[first].y);
+    if (d > dmax) {
+      dmax = d;
+      imax = i;
+    }
+  }
+  *dev = dmax;
+  return imax;
+}
+
+int nddExtractSegments(NDD_POINT * points,
+		       int n_pt,
+		       double splitDist,
+		       double maxGap,
+		       int minPoints,
+		       NDD_SEGMENT * segments,
+		       int maxSegs,
+		       NDD_POINT * lonelyPoints,
+		       int * n_lPoints,
+		       int maxLPoints) {
+  int stack[NDD_SPLIT_STACK];
+  int top;
+  int begin, end, first, last, split;
+  int prevFirst, prevSeg;
+  int n_segs = 0;
+  int i;
+  double dev;
+
+  if (minPoints < 2) minPoints = 2;
+  *n_lPoints = 0;
+
+  for (begin=0; begin<n_pt; begin=end+1) {
+    /* a run ends at an invalid point or at a gap */
+    if (points[begin].x == 0.0 && points[begin].y == 0.0) {
+      end = begin;
+      continue;
+    }
+    for (end=begin; end+1<n_pt; end++) {
+      if (points[end+1].x == 0.0 && points[end+1].y == 0.0)
+	break;
+      if (hypot(points[end+1].x - points[end].x,
+		points[end+1].y - points[end].y) > maxGap)
+	break;
+    }
+
+    /* split, left to right: the stack holds the pending right ends */
+    first = begin;
+    top = 0;
+    stack[top++] = end;
+    prevSeg = -1;
+    prevFirst = -1;
+    while (top > 0) {
+      last = stack[top-1];
+      split = nddFarthestFromChord(points, first, last, &dev);
+      if (dev > splitDist && top < NDD_SPLIT_STACK) {
+	stack[top++] = split;
+	continue;
+      }
+      top--;
+
+      if (last - first + 1 < minPoints) {
+	for (i=first; i<=last; i++)
+	  if (*n_lPoints < maxLPoints)
+	    lonelyPoints[(*n_lPoints)++] = points[i];
+	prevSeg = -1;
+      } else {
+	/* merge with the previous piece when they fit together */
+	if (prevSeg >= 0) {
+	  nddFarthestFromChord(points, prevFirst, last, &dev);
+	  if (dev <= splitDist) {
+	    segments[prevSeg].r2 = hypot(points[last].x, points[last].y);
+	    segments[prevSeg].t2 = atan2(points[last].y, points[last].x);
+	    first = last;
+	    continue;
+	  }
+	}
+	if (n_segs < maxSegs) {
+	  segments[n_segs].r1 = hypot(points[first].x, points[first].y);
+	  segments[n_segs].t1 = atan2(points[first].y, points[first].x);
+	  segments[n_segs].r2 = hypot(points[last].x, points[last].y);
+	  segments[n_segs].t2 = atan2(points[last].y, points[last].x);
+	  prevSeg = n_segs++;
+	  prevFirst = first;
+	} else {
+	  for (i=first; i<=last; i++)
+	    if (*n_lPoints < maxLPoints)
+	      lonelyPoints[(*n_lPoints)++] = points[i];
+	  prevSeg = -1;
+	}
+      }
+      first = last;
+    }
+  }
+  return n_segs;
+}
@@ -41,9 +41,73 @@ typedef struct NDD_SEGMENT {
   double r2, t2;
 } NDD_SEGMENT;
 
+/* Everything nddLib needs for one robot: the parameters, the enlargement
+   table, the diagram and the scratch arrays.  There is no other state, so
+   each thread can run its own context without locking. */
+typedef struct NDD_CONTEXT {
+  NDD_DIAGRAM diag;
+  float enlargement[NDD_NSECTORS];
+  nddSectorAcc acc[NDD_NSECTORS];
+  double dMaxLocalMap;
+  double security_distance;
+  double smax;
+  double vmax;
+  double wmax;
+  int linFactor;
+} NDD_CONTEXT;
+
 float * nddComputeEnlargement(int nSect, float lmaxRobot, float secuDist,
 			      float vmaxRobot, float timeStep);
 
+/* same as nddComputeEnlargement, into a caller-provided table of nSect */
+void nddFillEnlargement(float * e, int nSect, float lmaxRobot, float secuDist,
+			float vmaxRobot, float timeStep);
+
+/* initialises ctx once per robot configuration; return 1 if OK */
+int nddContextInit(NDD_CONTEXT * ctx,
+		   float dmaxSensor,
+		   float lmaxRobot,
+		   double security_distance,
+		   double dMaxLocalMap,
+		   double smax,
+		   double vmax,
+		   double wmax,
+		   int linFactor,
+		   float timeStep);
+
+int nddContextComputeRefFromPoints(NDD_CONTEXT * ctx,
+				   NDD_POINT * points,
+				   int n_pt,
+				   NDD_POINT * loc_goal,
+				   double *thetaRef,
+				   NDD_SPEED_REF *sr);
+
+int nddContextComputeRefFromSegments(NDD_CONTEXT * ctx,
+				     NDD_SEGMENT * segments,
+				     int n_segs,
+				     NDD_POINT * lonelyPoints,
+				     int n_lPoints,
+				     NDD_POINT * loc_goal,
+				     double *thetaRef,
+				     NDD_SPEED_REF *sr);
+
+
+/* Split-and-merge of an ordered scan (robot frame) into polar segments.
+   The scan is first cut where two consecutive points are more than maxGap
+   apart, each run is split at its farthest point from the chord until every
+   point is within splitDist, and consecutive pieces that fit together are
+   merged back.  Pieces of less than minPoints points go to lonelyPoints.
+   Returns the number of segments. */
+int nddExtractSegments(NDD_POINT * points,
+		       int n_pt,
+		       double splitDist,
+		       double maxGap,
+		       int minPoints,
+		       NDD_SEGMENT * segments,
+		       int maxSegs,
+		       NDD_POINT * lonelyPoints,
+		       int * n_lPoints,
+		       int maxLPoints);
 
 int nddComputeRefFromPoints(NDD_DIAGRAM * diag, 
 			    NDD_POINT * points, 
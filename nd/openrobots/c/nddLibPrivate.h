@@ -5,11 +5,15 @@ static NDD_BOOL nddIsNarrowValley (NDD_VALLEY * v, int max_n_sectors, int smax);
 static NDD_BOOL nddIsWideValley (NDD_VALLEY * v, int max_n_sectors, int smax);
 
 
-static int nddFillPndFromSegments(NDD_DIAGRAM * diag, NDD_SEGMENT * segments, 
-			   int n_segs, NDD_POINT * lonelyPoints, int n_lPoints);
+static int nddFillPndFromSegments(NDD_DIAGRAM * diag, nddSectorAcc * acc,
+			   NDD_SEGMENT * segments, int n_segs, double distMax,
+			   NDD_POINT * lonelyPoints, int n_lPoints);
 
-static int nddFillPndFromPoints(NDD_DIAGRAM * diag, NDD_POINT * points, int n_pt, 
-			 double distMax);
+static int nddFillPndFromPoints(NDD_DIAGRAM * diag, nddSectorAcc * acc,
+			 NDD_POINT * points, int n_pt, double distMax);
+
+static int nddFarthestFromChord(NDD_POINT * points, int first, int last,
+				double * dev);
 
 static void nddFillRnd(NDD_DIAGRAM * diag,  float * enlargement);
 
@@ -4,12 +4,82 @@
 #include "nddLib.h"
 #include <stdio.h>
 
-void nddFloatListFree(nddFloatList * list) {
-  nddFloatList * fl;
-  while (list != NULL) {
-    fl = list->next;
-    free(list);
-    list = fl;
+void nddSectorAccReset(nddSectorAcc * acc, int nsectors) {
+  int i;
+  for (i=0; i<nsectors; i++)
+    acc[i].state = NDD_ACC_EMPTY;
+}
+
+void nddSectorAccAdd(nddSectorAcc * acc, float v) {
+  if (acc->state == NDD_ACC_OCCUPIED)
+    return;
+  if (v == NDDLIB_PND_OCCUPIED)
+    acc->state = NDD_ACC_OCCUPIED;
+  else if ((acc->state == NDD_ACC_EMPTY) || (v < acc->min)) {
+    acc->min = v;
+    acc->state = NDD_ACC_VALUES;
+  }
+}
+
+/* Rasterises a polar segment into the sectors it spans: each sector gets
+   the distance to the nearest point of the part of the segment inside it.
+   With p the distance from the robot to the line and phi the direction of
+   its foot, the ray at angle t meets the line at p/cos(t-phi), so the
+   nearest point of a sector is the one whose angle is the closest to phi:
+   one evaluation per covered sector. */
+void nddSectorAccAddSegment(nddSectorAcc * acc, int nsectors,
+			    NDD_SEGMENT * seg) {
+  double w = 2.0 * M_PI / (double) nsectors;
+  double a, ra, rb, span;
+  double ax, ay, bx, by, dx, dy, len2;
+  double u, fx, fy, p, phi;
+  double lo, hi, t;
+  int first, j;
+
+  /* sweep counterclockwise, from a to a+span, with span in [0,pi] */
+  span = seg->t2 - seg->t1;
+  while (span > M_PI) span -= 2.0 * M_PI;
+  while (span <= -M_PI) span += 2.0 * M_PI;
+  if (span >= 0.0) {
+    a = seg->t1; ra = seg->r1; rb = seg->r2;
+  } else {
+    a = seg->t2; ra = seg->r2; rb = seg->r1;
+    span = -span;
+  }
+  a = fmod(a, 2.0 * M_PI);
+  if (a < 0.0) a += 2.0 * M_PI;
+  first = (int) floor(a / w);
+  if (first >= nsectors) first -= nsectors;
+
+  ax = ra * cos(a);
+  ay = ra * sin(a);
+  bx = rb * cos(a + span);
+  by = rb * sin(a + span);
+  dx = bx - ax;
+  dy = by - ay;
+  len2 = dx * dx + dy * dy;
+
+  u = (len2 > 0.0) ? -(ax * dx + ay * dy) / len2 : 0.0;
+  fx = ax + u * dx;
+  fy = ay + u * dy;
+  p = sqrt(fx * fx + fy * fy);
+
+  if (len2 <= 0.0 || p <= 1e-9) {
+    /* a point, or a segment whose line goes through the robot */
+    for (j=0, lo=0.0; lo<=span; j++, lo=(first + j) * w - a)
+      nddSectorAccAdd(&acc[(first + j) % nsectors], (ra < rb) ? ra : rb);
+    return;
+  }
+  /* angle of the foot of the perpendicular, from a */
+  phi = atan2(ax * fy - ay * fx, ax * fx + ay * fy);
+
+  for (j=0, lo=0.0; lo<=span; j++, lo=hi) {
+    hi = (first + j + 1) * w - a;
+    t = phi;
+    if (t < lo) t = lo;
+    else if (t > hi) t = hi;
+    if (t > span) t = span;
+    nddSectorAccAdd(&acc[(first + j) % nsectors], p / cos(t - phi));
   }
 }
 
@@ -77,26 +147,12 @@ int nddSectorDistance (int d1, int d2, int n) {
 }
 
 
-double nddEstimateDistToObstFromValues(nddFloatList* values_list) {
-  double min;
-
-  if (values_list == NULL)
+double nddEstimateDistToObstFromAcc(nddSectorAcc * acc) {
+  if (acc->state == NDD_ACC_EMPTY)
     return NDDLIB_PND_FREE;
-  min = values_list->v;
-  if (min == NDDLIB_PND_OCCUPIED)
+  if (acc->state == NDD_ACC_OCCUPIED)
     return NDDLIB_PND_OCCUPIED;
-
-  values_list = values_list->next;
-
-  while ( (values_list != NULL) &&
-	  (values_list->v != NDDLIB_PND_OCCUPIED) ) {    
-    if (values_list->v < min)
-      min = values_list->v;
-    values_list = values_list->next;
-  }
-  if (values_list == NULL)
-    return min;
-  return NDDLIB_PND_OCCUPIED;
+  return acc->min;
 }
 
 
@@ -20,17 +20,16 @@
 #define NDD_FINDVALLEYS_LOWERING_DISC_DETECTED 11
 #define NDD_FINDVALLEYS_END 12
 
-/* local structures  for fillPND */
-typedef struct nddFloatList {
-  float v;
-  struct nddFloatList *next;
-} nddFloatList;
+/* local structures  for fillPND: nddSectorAcc, in nddStruct.h */
 
 
 int nddSectorDistance (int d1, int d2, int n);
-void nddFloatListFree(nddFloatList * list);
+void nddSectorAccReset(nddSectorAcc * acc, int nsectors);
+void nddSectorAccAdd(nddSectorAcc * acc, float v);
+void nddSectorAccAddSegment(nddSectorAcc * acc, int nsectors,
+			    NDD_SEGMENT * seg);
 float nddEstimateDistToObsFromPND(int i, NDD_DIAGRAM * diag);
-double nddEstimateDistToObstFromValues(nddFloatList* values_list);
+double nddEstimateDistToObstFromAcc(nddSectorAcc * acc);
 
 void incJ (int *j, int modulo);
 void incIincJ(int *i, int *j, int modulo);
@@ -48,6 +47,7 @@ void nddGetSiAndSjFromSector(NDD_DIAGRAM * diag, int sector, int*si, int*sj);
 
 double nddGiveAngleFromSector(NDD_SECTOR sector, int nSectors);
 
+double nddDistToSeg(NDD_SEGMENT *seg);
 NDD_SEGMENT * nddFiltrateSegments(NDD_SEGMENT * segments, int n_segs, double dmax, int * newNSegs);
 
 int nddComputeAlpha(double lmax, double secuDist, double dDisc, int nsects);
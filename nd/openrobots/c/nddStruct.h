@@ -15,7 +15,7 @@ typedef enum NDD_OBST_TYPE {
   NDD_INPUT_POLAR_POINTS,
   NDD_INPUT_DEBUG,
   NDD_INPUT_POLAR_SEGS,
-  NDD_INPUT_CART_SEGS     /* the best when it will work but still BUGGY */
+  NDD_INPUT_CART_SEGS     /* the best: see nddExtractSegments for raw scans */
 } NDD_OBST_TYPE;
 
 typedef enum NDD_USING_THETA {
@@ -70,6 +70,19 @@ typedef struct NDD_DIAGRAM {
 } NDD_DIAGRAM;
 
 
+/* per-sector scratch for filling pnd: the estimator only needs the min of
+   the values seen in a sector and whether one of them was
+   NDDLIB_PND_OCCUPIED, so they are not stored */
+#define NDD_ACC_EMPTY 0
+#define NDD_ACC_VALUES 1
+#define NDD_ACC_OCCUPIED 2
+
+typedef struct nddSectorAcc {
+  float min;
+  int state;
+} nddSectorAcc;
+
+
 typedef struct NDD_CHOICE {
   double motionDirection;   /* angle relatively to robot frame */
   double valley;            /* direction selected by ndd */ 
@@ -0,0 +1,1267 @@
+/*
+ *  Player - One Hell of a Robot Server
+ *  Copyright (C) 2007
+ *     Brian Gerkey
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+
+/** @ingroup drivers */
+/** @{ */
+/** @defgroup driver_ndd ndd
+ * @brief Nearness Diagram Navigation (openrobots nddLib)
+
+This driver runs the openrobots implementation of Nearness Diagram
+Navigation (nddLib, in nd/openrobots/c) behind the same Player interface
+as the @ref driver_nd driver, so that both variants can be compared on the
+same robot and configuration.
+
+This driver reads pose information from a @ref interface_position2d
+device, sensor data from a @ref interface_laser device and/or @ref
+interface_sonar device, and writes commands to a @ref interface_position2d
+device.  The two @ref interface_position2d devices can be the same.
+At least one device of type @ref interface_laser or @ref interface_sonar must
+be provided.
+
+The driver itself supports the @ref interface_position2d interface.  Send
+@ref PLAYER_POSITION2D_CMD_POS commands to set the goal pose.  The driver
+also accepts @ref PLAYER_POSITION2D_CMD_VEL commands, simply passing them
+through to the underlying output device.
+
+
+@par Compile-time dependencies
+
+- none
+
+@par Provides
+
+- @ref interface_position2d
+
+@par Requires
+
+- "input" @ref interface_position2d : source of pose and velocity information
+- "output" @ref interface_position2d : sink for velocity commands to control the robot
+- @ref interface_laser : the laser to read from
+- @ref interface_sonar : the sonar to read from
+
+@par Configuration requests
+
+- all @ref interface_position2d requests are passed through to the
+underlying "output" @ref interface_position2d device.
+
+@par Configuration file options
+
+- goal_tol (tuple: [length angle])
+  - Default: [0.5 10.0] (m deg)
+  - Respectively, translational and rotational goal tolerance.  When the
+    robot is within these bounds of the current target pose, it will
+    be stopped.
+
+- max_speed (tuple: [length/sec angle/sec])
+  - Default: [0.3 45.0] (m/s deg/s)
+  - Respectively, maximum absolute translational and rotational velocities
+    to be used in commanding the robot.
+
+- min_speed (tuple: [length/sec angle/sec])
+  - Default: [0.05 10.0] (m/s deg/s)
+  - Respectively, minimum absolute non-zero translational and rotational
+    velocities to be used in commanding the robot.
+
+- safety_dist (length)
+  - Default: 0.6 m
+  - Security distance of nddLib: the robot stops when an obstacle comes
+    closer than this (it is measured from the centre of the robot).
+
+- local_map_dist (length)
+  - Default: 10.0 m
+  - Obstacles farther than this from the robot are ignored.
+
+- smax (integer)
+  - Default: 18
+  - Valleys wider than this number of sectors (out of 144) are considered
+    wide.
+
+- lin_factor (integer)
+  - Default: 3
+  - Smoothness of the trajectory: with small values the linear velocity
+    drops quickly when the robot has to turn.
+
+- enlargement_factor (float)
+  - Default: 1.0
+  - Number of 0.1 s cycles of motion at maximum speed anticipated when
+    the obstacles are enlarged.
+
+- rotate_stuck_time (float)
+  - Default: 2.0 seconds
+  - How long the robot is allowed to rotate in place without making any
+    progress toward the goal orientation before giving up.
+
+- translate_stuck_time (float)
+  - Default: 2.0 seconds
+  - How long the robot is allowed to translate without making sufficient
+    progress toward the goal position before giving up.
+
+- translate_stuck_dist (length)
+  - Default: 0.25 m
+  - How far the robot must translate during translate stuck time in
+    order to not give up.
+
+- translate_stuck_angle (angle)
+  - Default: 20 deg
+  - How far the robot must rotate during translate stuck time in order
+    to not give up.
+
+- wait_on_stall (integer)
+  - Default: 0
+  - Should local navigation be paused if the stall flag is set on the
+    input position2d device?
+
+- laser_buffer (integer)
+  - Default: 10
+  - How many recent laser scans to consider in the local navigation.
+
+- sonar_buffer (integer)
+  - Default: 10
+  - How many recent sonar scans to consider in the local navigation
+
+- sonar_bad_transducers (tuple [integers])
+  - Default: [] (empty tuple)
+  - Indices of sonar transducers that should be ignored.
+
+- min_period (float)
+  - Default: 0.0 seconds
+  - Minimum time between two cycles.  The driver runs one cycle for
+    each new laser or sonar scan.
+
+- max_odom_wait (float)
+  - Default: 0.1 seconds
+  - How long a new scan may wait for an odometry update before the cycle
+    is run with the last known pose.
+
+@par Example
+
+@verbatim
+driver
+(
+  name "ndd"
+  provides ["position2d:1"]
+  requires ["output:::position2d:0" "input:::position2d:0" "laser:0"]
+
+  max_speed [0.3 30.0]
+  min_speed [0.1 10.0]
+  goal_tol [0.3 15.0]
+  safety_dist 0.4
+
+  laser_buffer 1
+)
+@endverbatim
+
+@author openrobots (nddLib), driver based on the @ref driver_nd integration by Brian Gerkey
+
+*/
+/** @} */
+#include <math.h>
+#if !defined (WIN32) || defined (__MINGW32__)
+  #include <unistd.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <float.h>
+
+#include <libplayercore/playercore.h>
+
+extern "C" {
+#include "nddLib.h"
+}
+
+#include "clock.h"
+
+#if defined (WIN32)
+  #define hypot _hypot
+#endif
+
+// Capacity of one buffered scan, and of the merged obstacle list
+#define NDD_MAX_POINTS 10000
+
+typedef struct
+{
+  int count;
+  NDD_POINT points[NDD_MAX_POINTS];   // odometric frame
+} ndd_scan_t;
+
+class NDD : public ThreadedDriver
+{
+  public:
+    // Constructor
+    NDD( ConfigFile* cf, int section);
+
+    // Destructor
+    virtual ~NDD();
+
+    // Setup/shutdown routines.
+    virtual int MainSetup();
+    virtual void MainQuit();
+
+    // Process incoming messages from clients
+    virtual int ProcessMessage(QueuePointer &resp_queue,
+                               player_msghdr * hdr,
+                               void * data);
+    // Main function for device thread.
+    virtual void Main();
+
+  private:
+    bool active_goal;
+    player_pose2d_t goal;
+    player_pose2d_t last_odom_pose;
+    player_pose2d_t odom_pose;
+    player_pose2d_t odom_vel;
+
+    double rotate_start_time;
+    double rotate_min_error;
+    double rotate_stuck_time;
+
+    double translate_start_time;
+    double translate_stuck_time;
+    double translate_stuck_dist;
+    double translate_stuck_angle;
+    bool wait_on_stall;
+    bool waiting;
+
+    bool stall;
+    bool turning_in_place;
+
+    // nddLib state (diagram, enlargement table and scratch) and parameters
+    NDD_CONTEXT ndd;
+    double safety_dist;
+    double local_map_dist;
+    int smax;
+    int lin_factor;
+    double enlargement_factor;
+
+    // Merged obstacle list, in the robot frame
+    NDD_POINT* obstacles;
+    int num_obstacles;
+
+    ndd_scan_t* laser_obstacles;
+    int num_laser_scans;
+
+    ndd_scan_t* sonar_obstacles;
+    int num_sonar_scans;
+
+    double vx_max, va_max;
+    double vx_min, va_min;
+    player_position2d_geom_t robot_geom;
+
+    double Threshold(double v, double v_min, double v_max);
+    int SetupOdom();
+    int ShutdownOdom();
+    int SetupLaser();
+    int ShutdownLaser();
+    int SetupSonar();
+    int ShutdownSonar();
+
+    void ProcessOutputOdom(player_msghdr_t* hdr, player_position2d_data_t* data);
+    void ProcessInputOdom(player_msghdr_t* hdr, player_position2d_data_t* data);
+    void ProcessLaser(player_msghdr_t* hdr, player_laser_data_t* data);
+    void ProcessSonar(player_msghdr_t* hdr, player_sonar_data_t* data);
+    void ProcessCommand(player_msghdr_t* hdr, player_position2d_cmd_vel_t* cmd);
+    void ProcessCommand(player_msghdr_t* hdr, player_position2d_cmd_pos_t* cmd);
+    // Get a free slot of a scan ring buffer
+    ndd_scan_t* PushScan(ndd_scan_t* scans, int* num_scans, int buffer);
+    // Mark that a new scan is waiting for a cycle
+    void ScanArrived();
+    // Tell whether a cycle is due; if not, how long to wait for one
+    bool CycleDue(double* timeout);
+    // Move the buffered obstacles into the robot frame
+    void MergeObstacles();
+    // Run nddLib towards a goal in the odometric frame
+    void ComputeRef(double gx, double gy, double* vx, double* va);
+    // Send a command to the motors
+    void PutPositionCmd(double vx, double va);
+
+    // Computes the signed minimum difference between the two angles.
+    double angle_diff(double a, double b);
+
+    // Odometry device info
+    Device *odom;
+    player_devaddr_t odom_addr;
+    Device *localize;
+    player_devaddr_t localize_addr;
+    double dist_eps;
+    double ang_eps;
+
+    // Laser device info
+    Device *laser;
+    player_devaddr_t laser_addr;
+    player_pose3d_t laser_pose;
+    int laser_buffer;
+
+    // Sonar device info
+    Device *sonar;
+    player_devaddr_t sonar_addr;
+    int num_sonars;
+    player_pose3d_t * sonar_poses;
+    // indices of known bad sonars
+    int * bad_sonars;
+    int bad_sonar_count;
+    int sonar_buffer;
+
+    // Cycle scheduling: one cycle per new scan
+    double min_period;
+    double max_odom_wait;
+    bool have_odom;
+    bool odom_fresh;
+    bool scan_pending;
+    double scan_time;
+    double last_cycle_time;
+
+    // Performance data.
+    stat_t statistics;
+    lat_t latency;
+};
+
+// Initialization function
+Driver*
+NDD_Init(ConfigFile* cf, int section)
+{
+  return ((Driver*) (new NDD( cf, section)));
+}
+
+// a driver registration function
+void ndd_Register(DriverTable* table)
+{
+  table->AddDriver("ndd",  NDD_Init);
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructor
+NDD::NDD( ConfigFile* cf, int section)
+  : ThreadedDriver(cf, section, false, PLAYER_MSGQUEUE_DEFAULT_MAXLEN, PLAYER_POSITION2D_CODE)
+{
+  this->dist_eps = cf->ReadTupleLength(section, "goal_tol", 0, 0.5);
+  this->ang_eps = cf->ReadTupleAngle(section, "goal_tol", 1, DTOR(10.0));
+
+  this->vx_max = cf->ReadTupleLength(section, "max_speed", 0, 0.3);
+  this->va_max = cf->ReadTupleAngle(section, "max_speed", 1, DTOR(45.0));
+  this->vx_min = cf->ReadTupleLength(section, "min_speed", 0, 0.05);
+  this->va_min = cf->ReadTupleAngle(section, "min_speed", 1, DTOR(10.0));
+
+  this->safety_dist = cf->ReadLength(section, "safety_dist",
+                                     NDD_DEFAULT_SECURITY_DISTANCE);
+  this->local_map_dist = cf->ReadLength(section, "local_map_dist",
+                                        NDD_DEFAULT_DMAXLOCALMAP);
+  this->smax = cf->ReadInt(section, "smax", NDD_DEFAULT_SMAX);
+  this->lin_factor = cf->ReadInt(section, "lin_factor", NDD_DEFAULT_LIN_FACTOR);
+  this->enlargement_factor = cf->ReadFloat(section, "enlargement_factor",
+                                           NDD_DEFAULT_ENLARGEMENT_FACTOR);
+  this->rotate_stuck_time = cf->ReadFloat(section, "rotate_stuck_time", 2.0);
+
+  this->translate_stuck_time = cf->ReadFloat(section, "translate_stuck_time",
+                                             2.0);
+  this->translate_stuck_dist = cf->ReadLength(section, "translate_stuck_dist",
+                                              0.25);
+  this->translate_stuck_angle = cf->ReadAngle(section, "translate_stuck_angle",
+                                               DTOR(20.0));
+  this->wait_on_stall =
+          cf->ReadInt(section, "wait_on_stall", 0) ?  true : false;
+  this->min_period = cf->ReadFloat(section, "min_period", 0.0);
+  this->max_odom_wait = cf->ReadFloat(section, "max_odom_wait", 0.1);
+
+  this->obstacles = NULL;
+
+  this->odom = NULL;
+  if (cf->ReadDeviceAddr(&this->odom_addr, section, "requires",
+                         PLAYER_POSITION2D_CODE, -1, "output") != 0)
+  {
+    this->SetError(-1);
+    return;
+  }
+
+  this->localize = NULL;
+  if (cf->ReadDeviceAddr(&this->localize_addr, section, "requires",
+                         PLAYER_POSITION2D_CODE, -1, "input") != 0)
+  {
+    this->SetError(-1);
+    return;
+  }
+
+  this->laser = NULL;
+  memset(&this->laser_addr,0,sizeof(player_devaddr_t));
+  cf->ReadDeviceAddr(&this->laser_addr, section, "requires",
+                     PLAYER_LASER_CODE, -1, NULL);
+  if(this->laser_addr.interf)
+  {
+    this->laser_buffer = cf->ReadInt(section, "laser_buffer", 10);
+  }
+
+  this->sonar = NULL;
+  this->bad_sonars = NULL;
+  this->bad_sonar_count = 0;
+  memset(&this->sonar_addr,0,sizeof(player_devaddr_t));
+  cf->ReadDeviceAddr(&this->sonar_addr, section, "requires",
+                     PLAYER_SONAR_CODE, -1, NULL);
+  if(this->sonar_addr.interf)
+  {
+    if((this->bad_sonar_count =
+        cf->GetTupleCount(section, "sonar_bad_transducers")))
+    {
+      this->bad_sonars = new int[bad_sonar_count];
+      for(int i=0;i<this->bad_sonar_count;i++)
+        this->bad_sonars[i] = cf->ReadTupleInt(section,
+                                               "sonar_bad_transducers",
+                                               i, -1);
+    }
+    this->sonar_buffer = cf->ReadInt(section, "sonar_buffer", 10);
+  }
+
+  if(!this->laser_addr.interf && !this->sonar_addr.interf)
+  {
+    PLAYER_ERROR("NDD needs at least one sonar or one laser");
+    this->SetError(-1);
+    return;
+  }
+
+  return;
+}
+
+
+NDD::~NDD()
+{
+  if (bad_sonars) delete [] bad_sonars;
+  return;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Set up the device (called by server thread).
+int NDD::MainSetup()
+{
+  // Initialise the underlying position device.
+  if (this->SetupOdom() != 0)
+    return -1;
+
+  this->active_goal = false;
+
+  // Initialise the laser.
+  this->num_laser_scans = 0;
+  if (this->laser_addr.interf && this->SetupLaser() != 0)
+    return -1;
+  this->num_sonar_scans = 0;
+  if (this->sonar_addr.interf && this->SetupSonar() != 0)
+    return -1;
+
+  this->obstacles = (NDD_POINT*)malloc(NDD_MAX_POINTS * sizeof(NDD_POINT));
+  assert(this->obstacles);
+  this->num_obstacles = 0;
+
+  this->stall = false;
+  this->turning_in_place = false;
+  this->last_odom_pose.px =
+          this->last_odom_pose.py =
+          this->last_odom_pose.pa = FLT_MAX;
+
+  this->waiting = false;
+
+  this->have_odom = false;
+  this->odom_fresh = false;
+  this->scan_pending = false;
+  this->last_cycle_time = 0.0;
+
+  statReset(&this->statistics);
+  latReset(&this->latency);
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shutdown the device (called by server thread).
+void NDD::MainQuit()
+{
+  // Stop the laser
+  if(this->laser)
+    this->ShutdownLaser();
+
+  // Stop the sonar
+  if(this->sonar)
+    this->ShutdownSonar();
+
+  // Stop the odom device.
+  this->ShutdownOdom();
+
+  free(this->obstacles);
+  this->obstacles = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Set up the underlying odom device.
+int NDD::SetupOdom()
+{
+  // Setup the output position device
+  if(!(this->odom = deviceTable->GetDevice(this->odom_addr)))
+  {
+    PLAYER_ERROR("unable to locate suitable output position device");
+    return -1;
+  }
+  if(this->odom->Subscribe(this->InQueue) != 0)
+  {
+    PLAYER_ERROR("unable to subscribe to output position device");
+    return -1;
+  }
+
+  // Setup the input position device
+  if(!(this->localize = deviceTable->GetDevice(this->localize_addr)))
+  {
+    PLAYER_ERROR("unable to locate suitable input position device");
+    return -1;
+  }
+  if(this->localize->Subscribe(this->InQueue) != 0)
+  {
+    PLAYER_ERROR("unable to subscribe to input position device");
+    return -1;
+  }
+
+  // Get the odometry geometry
+  Message* msg;
+  if(!(msg = this->odom->Request(this->InQueue,
+                                 PLAYER_MSGTYPE_REQ,
+                                 PLAYER_POSITION2D_REQ_GET_GEOM,
+                                 NULL, 0, NULL, true)) ||
+     (msg->GetHeader()->size != sizeof(player_position2d_geom_t)))
+  {
+    PLAYER_ERROR("failed to get geometry of underlying position device");
+    if(msg)
+      delete msg;
+    return(-1);
+  }
+  player_position2d_geom_t* geom = (player_position2d_geom_t*)msg->GetPayload();
+
+  this->robot_geom = *geom;
+  delete msg;
+
+  memset(&this->odom_pose, 0, sizeof(this->odom_pose));
+  memset(&this->odom_vel, 0, sizeof(this->odom_vel));
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shutdown the underlying odom device.
+int NDD::ShutdownOdom()
+{
+  // Stop the robot before unsubscribing
+  this->PutPositionCmd(0.0,0.0);
+  this->odom->Unsubscribe(this->InQueue);
+  this->localize->Unsubscribe(this->InQueue);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Set up the laser
+int NDD::SetupLaser()
+{
+  if(!(this->laser = deviceTable->GetDevice(this->laser_addr)))
+  {
+    PLAYER_ERROR("unable to locate suitable laser device");
+    return -1;
+  }
+  if (this->laser->Subscribe(this->InQueue) != 0)
+  {
+    PLAYER_ERROR("unable to subscribe to laser device");
+    return -1;
+  }
+
+  player_laser_geom_t* cfg;
+  Message* msg;
+
+  // Get the laser pose
+  if(!(msg = this->laser->Request(this->InQueue,
+                                  PLAYER_MSGTYPE_REQ,
+                                  PLAYER_LASER_REQ_GET_GEOM,
+                                  NULL, 0, NULL, true)))
+  {
+    PLAYER_ERROR("failed to get laser geometry");
+    return(-1);
+  }
+
+  // Store the laser pose
+  cfg = (player_laser_geom_t*)msg->GetPayload();
+  this->laser_pose = cfg->pose;
+  delete msg;
+
+  // Allocate space for laser scans that we'll buffer
+  this->laser_obstacles = (ndd_scan_t*)malloc(this->laser_buffer *
+                                              sizeof(ndd_scan_t));
+  assert(this->laser_obstacles);
+  this->num_laser_scans = 0;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Set up the sonar
+int NDD::SetupSonar()
+{
+  if(!(this->sonar = deviceTable->GetDevice(this->sonar_addr)))
+  {
+    PLAYER_ERROR("unable to locate suitable sonar device");
+    return -1;
+  }
+  if (this->sonar->Subscribe(this->InQueue) != 0)
+  {
+    PLAYER_ERROR("unable to subscribe to sonar device");
+    return -1;
+  }
+
+  player_sonar_geom_t* cfg;
+  Message* msg;
+
+  // Get the sonar poses
+  if(!(msg = this->sonar->Request(this->InQueue,
+                                  PLAYER_MSGTYPE_REQ,
+                                  PLAYER_SONAR_REQ_GET_GEOM,
+                                  NULL, 0, NULL,false)))
+  {
+    PLAYER_ERROR("failed to get sonar geometry");
+    return(-1);
+  }
+
+  // Store the sonar poses
+  cfg = (player_sonar_geom_t*)msg->GetPayload();
+  this->num_sonars = cfg->poses_count;
+  this->sonar_poses = new player_pose3d_t[num_sonars];
+  for(int i=0;i<this->num_sonars;i++)
+  {
+    this->sonar_poses[i] = cfg->poses[i];
+  }
+  delete msg;
+
+  // Allocate space for sonar scans that we'll buffer
+  this->sonar_obstacles = (ndd_scan_t*)malloc(this->sonar_buffer *
+                                              sizeof(ndd_scan_t));
+  assert(this->sonar_obstacles);
+  this->num_sonar_scans = 0;
+
+  return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Shut down the laser
+int NDD::ShutdownLaser()
+{
+  this->laser->Unsubscribe(this->InQueue);
+  free(this->laser_obstacles);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shut down the sonar
+int NDD::ShutdownSonar()
+{
+  this->sonar->Unsubscribe(this->InQueue);
+  delete [] sonar_poses;
+  free(this->sonar_obstacles);
+  return 0;
+}
+
+// Send a command to the motors
+void
+NDD::PutPositionCmd(double vx, double va)
+{
+  player_position2d_cmd_vel_t cmd;
+
+  memset(&cmd,0,sizeof(player_position2d_cmd_vel_t));
+
+  cmd.vel.px = vx;
+  cmd.vel.pa = va;
+  cmd.state = 1;
+
+  this->odom->PutMsg(this->InQueue,
+                     PLAYER_MSGTYPE_CMD,
+                     PLAYER_POSITION2D_CMD_VEL,
+                     (void*)&cmd,sizeof(cmd),NULL);
+}
+
+void
+NDD::ProcessInputOdom(player_msghdr_t* hdr, player_position2d_data_t* data)
+{
+  this->odom_pose = data->pos;
+  this->have_odom = true;
+  this->odom_fresh = true;
+
+  player_msghdr_t newhdr = *hdr;
+  newhdr.addr = this->device_addr;
+  player_position2d_data_t newdata;
+
+  newdata.pos = data->pos;
+  newdata.vel = this->odom_vel;
+  if(data->stall)
+  {
+    if(this->wait_on_stall)
+    {
+      // We'll stop the robot and wait for the stall flag to clear itself,
+      // but not report the stall
+      this->PutPositionCmd(0.0,0.0);
+      this->waiting = true;
+      newdata.stall = 0;
+    }
+    else
+      newdata.stall = 1;
+  }
+  else
+  {
+    newdata.stall = 0;
+    this->waiting = false;
+  }
+
+  // this->stall indicates that we're stuck.  Set the stall flag to let
+  // whoever's listening that we've given up.
+  if(this->stall)
+    newdata.stall = 1;
+
+  this->Publish(&newhdr, &newdata);
+}
+
+void
+NDD::ProcessOutputOdom(player_msghdr_t* hdr, player_position2d_data_t* data)
+{
+  this->odom_vel = data->vel;
+}
+
+ndd_scan_t*
+NDD::PushScan(ndd_scan_t* scans, int* num_scans, int buffer)
+{
+  // Is the scan buffer full?
+  if(*num_scans == buffer)
+  {
+    // pop the oldest one off
+    memmove(scans, scans+1, (*num_scans-1) * sizeof(ndd_scan_t));
+    return scans + *num_scans - 1;
+  }
+  // we're still filling the buffer; add this one to the end
+  return scans + (*num_scans)++;
+}
+
+void
+NDD::ProcessLaser(player_msghdr_t* hdr, player_laser_data_t* scan)
+{
+  double x, y, rx, ry, r, b;
+  ndd_scan_t* obs;
+  unsigned int n;
+
+  this->ScanArrived();
+
+  obs = this->PushScan(this->laser_obstacles, &this->num_laser_scans,
+                       this->laser_buffer);
+
+  n = scan->ranges_count;
+  if(n > NDD_MAX_POINTS)
+    n = NDD_MAX_POINTS;
+  for(unsigned int i=0;i<n;i++)
+  {
+    b = scan->min_angle + (i * scan->resolution);
+    r = scan->ranges[i];
+
+    // convert to cartesian coords, in the laser's frame
+    x = r * cos(b);
+    y = r * sin(b);
+
+    // convert to the robot's frame
+    rx = (this->laser_pose.px +
+          x * cos(this->laser_pose.pyaw) -
+          y * sin(this->laser_pose.pyaw));
+    ry = (this->laser_pose.py +
+          x * sin(this->laser_pose.pyaw) +
+          y * cos(this->laser_pose.pyaw));
+
+    // convert to the odometric frame and add to the obstacle list
+    obs->points[i].x = this->odom_pose.px +
+                       rx * cos(this->odom_pose.pa) -
+                       ry * sin(this->odom_pose.pa);
+    obs->points[i].y = this->odom_pose.py +
+                       rx * sin(this->odom_pose.pa) +
+                       ry * cos(this->odom_pose.pa);
+  }
+  obs->count = n;
+}
+
+void
+NDD::ProcessSonar(player_msghdr_t* hdr, player_sonar_data_t* scan)
+{
+  double rx, ry, r;
+  ndd_scan_t* obs;
+  int j;
+  int count = 0;
+
+  this->ScanArrived();
+
+  obs = this->PushScan(this->sonar_obstacles, &this->num_sonar_scans,
+                       this->sonar_buffer);
+
+  for(unsigned int i=0;i<scan->ranges_count && (int)i<this->num_sonars;i++)
+  {
+    r = scan->ranges[i];
+
+    // Is this a bad transducer?
+    for(j=0;j<this->bad_sonar_count;j++)
+    {
+      if(this->bad_sonars[j] == (int)i)
+        break;
+    }
+    if(j<this->bad_sonar_count)
+      continue;
+
+    // convert to the robot's frame
+    rx = this->sonar_poses[i].px + r * cos(this->sonar_poses[i].pyaw);
+    ry = this->sonar_poses[i].py + r * sin(this->sonar_poses[i].pyaw);
+
+    // convert to the odometric frame and add to the obstacle list
+    obs->points[count].x = this->odom_pose.px +
+                           rx * cos(this->odom_pose.pa) -
+                           ry * sin(this->odom_pose.pa);
+    obs->points[count].y = this->odom_pose.py +
+                           rx * sin(this->odom_pose.pa) +
+                           ry * cos(this->odom_pose.pa);
+    count++;
+  }
+  obs->count = count;
+}
+
+void
+NDD::ScanArrived()
+{
+  // Keep the arrival time of the oldest scan not yet used, so the
+  // latency we report is the worst one.
+  if(!this->scan_pending)
+  {
+    this->scan_time = clockNow();
+    this->scan_pending = true;
+  }
+}
+
+bool
+NDD::CycleDue(double* timeout)
+{
+  double now, left;
+
+  // Block until the next message
+  *timeout = 0.0;
+
+  if(!this->scan_pending || !this->have_odom)
+    return false;
+
+  now = clockNow();
+
+  // Give the odometry a chance to catch up with the scan
+  if(!this->odom_fresh)
+  {
+    left = this->max_odom_wait - (now - this->scan_time);
+    if(left > 0.0)
+    {
+      *timeout = left;
+      return false;
+    }
+  }
+
+  // Do not run faster than requested
+  left = this->min_period - (now - this->last_cycle_time);
+  if(left > 0.0)
+  {
+    *timeout = left;
+    return false;
+  }
+
+  this->last_cycle_time = now;
+  return true;
+}
+
+void
+NDD::MergeObstacles()
+{
+  // nddLib works in the robot frame
+  double c = cos(this->odom_pose.pa);
+  double s = sin(this->odom_pose.pa);
+  double dx, dy;
+  int n = 0;
+  ndd_scan_t* scans[2] = { this->laser_obstacles, this->sonar_obstacles };
+  int num_scans[2] = { this->num_laser_scans, this->num_sonar_scans };
+
+  for(int k=0;k<2;k++)
+    for(int i=0;i<num_scans[k];i++)
+      for(int j=0;j<scans[k][i].count && n<NDD_MAX_POINTS;j++)
+      {
+        dx = scans[k][i].points[j].x - this->odom_pose.px;
+        dy = scans[k][i].points[j].y - this->odom_pose.py;
+        this->obstacles[n].x = dx * c + dy * s;
+        this->obstacles[n].y = -dx * s + dy * c;
+        n++;
+      }
+  this->num_obstacles = n;
+}
+
+void
+NDD::ComputeRef(double gx, double gy, double* vx, double* va)
+{
+  NDD_POINT loc_goal;
+  NDD_SPEED_REF sr;
+  double theta_ref;
+  double dx = gx - this->odom_pose.px;
+  double dy = gy - this->odom_pose.py;
+  double c = cos(this->odom_pose.pa);
+  double s = sin(this->odom_pose.pa);
+
+  loc_goal.x = dx * c + dy * s;
+  loc_goal.y = -dx * s + dy * c;
+
+  statStart(&this->statistics);
+  nddContextComputeRefFromPoints(&this->ndd,
+                                 this->obstacles, this->num_obstacles,
+                                 &loc_goal, &theta_ref, &sr);
+  statStop(&this->statistics);
+
+  *vx = sr.v;
+  *va = sr.w;
+}
+
+void
+NDD::ProcessCommand(player_msghdr_t* hdr, player_position2d_cmd_vel_t* cmd)
+{
+  if(!cmd->state)
+  {
+    this->PutPositionCmd(0.0,0.0);
+    this->active_goal = false;
+  }
+  else
+  {
+    PLAYER_MSG2(2, "Stopped by velocity command (%.3f %.3f)",
+                cmd->vel.px, RTOD(cmd->vel.pa));
+    this->PutPositionCmd(cmd->vel.px, cmd->vel.pa);
+    this->active_goal = false;
+  }
+}
+
+void
+NDD::ProcessCommand(player_msghdr_t* hdr, player_position2d_cmd_pos_t* cmd)
+{
+  PLAYER_MSG3(2, "New goal: (%.3f %.3f %.3f)",
+              cmd->pos.px,
+              cmd->pos.py,
+              RTOD(cmd->pos.pa));
+  // position control;  cache the goal and we'll process it in the main
+  // loop.
+  this->goal = cmd->pos;
+
+  this->active_goal = true;
+  this->turning_in_place = false;
+  this->stall = false;
+  GlobalTime->GetTimeDouble(&this->translate_start_time);
+  this->last_odom_pose = this->odom_pose;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Process an incoming message
+int NDD::ProcessMessage(QueuePointer &resp_queue,
+                        player_msghdr * hdr,
+                        void * data)
+{
+  // Is it new odometry data?
+  if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_DATA,
+                           PLAYER_POSITION2D_DATA_STATE,
+                           this->odom_addr))
+  {
+    this->ProcessOutputOdom(hdr, (player_position2d_data_t*)data);
+
+    // In case the input and output are the same device
+    if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_DATA,
+                             PLAYER_POSITION2D_DATA_STATE,
+                             this->localize_addr))
+      this->ProcessInputOdom(hdr, (player_position2d_data_t*)data);
+
+    return(0);
+  }
+  // Is it new localization data?
+  else if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_DATA,
+                           PLAYER_POSITION2D_DATA_STATE,
+                           this->localize_addr))
+  {
+    this->ProcessInputOdom(hdr, (player_position2d_data_t*)data);
+    return(0);
+  }
+  // Is it a new laser scan?
+  else if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_DATA,
+                                PLAYER_LASER_DATA_SCAN,
+                                this->laser_addr))
+  {
+    this->ProcessLaser(hdr, (player_laser_data_t*)data);
+    return(0);
+  }
+  // Is it a new sonar scan?
+  else if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_DATA,
+                                PLAYER_SONAR_DATA_RANGES,
+                                this->sonar_addr))
+  {
+    this->ProcessSonar(hdr, (player_sonar_data_t*)data);
+    return(0);
+  }
+  // Is it a new goal?
+  else if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_CMD,
+                                PLAYER_POSITION2D_CMD_POS,
+                                this->device_addr))
+  {
+    this->ProcessCommand(hdr, (player_position2d_cmd_pos_t*)data);
+    return 0;
+  }
+  else if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_CMD,
+                                PLAYER_POSITION2D_CMD_VEL,
+                                this->device_addr))
+  {
+    this->ProcessCommand(hdr, (player_position2d_cmd_vel_t*)data);
+    return 0;
+  }
+  // Is it a request for the underlying device?
+  else if(Message::MatchMessage(hdr, PLAYER_MSGTYPE_REQ, -1, this->device_addr))
+  {
+    // Pass the request on to the underlying position device and wait for
+    // the reply.
+    Message* msg;
+
+    if(!(msg = this->odom->Request(this->InQueue,
+                                   hdr->type,
+                                   hdr->subtype,
+                                   (void*)data,
+                                   hdr->size,
+                                   &hdr->timestamp,
+                                   true)))
+    {
+      PLAYER_WARN1("failed to forward config request with subtype: %d\n",
+                   hdr->subtype);
+      return(-1);
+    }
+
+    player_msghdr_t* rephdr = msg->GetHeader();
+    void* repdata = msg->GetPayload();
+    // Copy in our address and forward the response
+    rephdr->addr = this->device_addr;
+    this->Publish(resp_queue, rephdr, repdata);
+    delete msg;
+    return(0);
+  }
+  else
+    return -1;
+}
+
+double
+NDD::Threshold(double v, double v_min, double v_max)
+{
+  if(v == 0.0)
+    return(v);
+  else if(v > 0.0)
+  {
+    v = MIN(v, v_max);
+    v = MAX(v, v_min);
+    return(v);
+  }
+  else
+  {
+    v = MAX(v, -v_max);
+    v = MIN(v, -v_min);
+    return(v);
+  }
+}
+
+void
+NDD::Main()
+{
+  double g_dx, g_da;
+  double vx, va;
+  double timeout = 0.0;
+  double lmax;
+
+  // Fill in the nddLib context: it sees the robot as a disc whose
+  // diameter is the diagonal of the footprint
+  lmax = hypot(this->robot_geom.size.sl, this->robot_geom.size.sw);
+  nddContextInit(&this->ndd,
+                 NDD_DMAX_SICK,
+                 static_cast<float> (lmax),
+                 this->safety_dist,
+                 this->local_map_dist,
+                 this->smax,
+                 this->vx_max, this->va_max,
+                 this->lin_factor,
+                 static_cast<float> (0.1 * this->enlargement_factor));
+
+  for(;;)
+  {
+    // Sleep until new messages arrive (or until a deferred cycle is due)
+    this->Wait(timeout);
+    timeout = 0.0;
+
+    pthread_testcancel();
+
+    // this->laser_obstacles and this->sonar_obstacles get updated by this
+    // call
+    this->ProcessMessages();
+
+    // are we waiting for a stall to clear?
+    if(this->waiting)
+      continue;
+
+    // do we have a goal?
+    if(!this->active_goal)
+    {
+      this->scan_pending = false;
+      continue;
+    }
+
+    // Run once per new scan
+    if(!this->CycleDue(&timeout))
+      continue;
+    this->scan_pending = false;
+    this->odom_fresh = false;
+
+    this->MergeObstacles();
+
+    // are we at the goal?
+    g_dx = hypot(this->goal.px-this->odom_pose.px,
+                 this->goal.py-this->odom_pose.py);
+    g_da = this->angle_diff(this->goal.pa, this->odom_pose.pa);
+
+    // Are we there?
+    if((g_dx < this->dist_eps) && (fabs(g_da) < this->ang_eps))
+    {
+      this->active_goal = false;
+      this->PutPositionCmd(0.0,0.0);
+      PLAYER_MSG0(1, "At goal");
+      // Print statistics.
+      statPrint(&this->statistics);
+      latPrint(&this->latency, "scan to command");
+      statReset(&this->statistics);
+      latReset(&this->latency);
+      continue;
+    }
+
+    // are we close enough in distance?
+    if((g_dx < this->dist_eps) || (this->turning_in_place))
+    {
+      PLAYER_MSG0(3, "Turning in place");
+      // To make the robot turn (safely) to the goal orientation, we'll
+      // give it a fake goal that is in the right direction, and just
+      // ignore the translational velocity.
+      this->ComputeRef(this->odom_pose.px + 10.0 * cos(this->goal.pa),
+                       this->odom_pose.py + 10.0 * sin(this->goal.pa),
+                       &vx, &va);
+      vx = 0.0;
+
+      if(!this->turning_in_place)
+      {
+        // first time; cache the time and current heading error
+        GlobalTime->GetTimeDouble(&this->rotate_start_time);
+        this->rotate_min_error = fabs(g_da);
+        this->turning_in_place = true;
+      }
+      else if(fabs(g_da) < this->rotate_min_error)
+      {
+        // making progress; reset the time
+        GlobalTime->GetTimeDouble(&this->rotate_start_time);
+        this->rotate_min_error = fabs(g_da);
+      }
+      else
+      {
+        // no progress; have we run out of time?
+        double t;
+        GlobalTime->GetTimeDouble(&t);
+        if((t - this->rotate_start_time) > this->rotate_stuck_time)
+        {
+          PLAYER_WARN("Ran out of time trying to attain goal heading");
+          this->PutPositionCmd(0.0, 0.0);
+          this->stall = true;
+          this->active_goal = false;
+          continue;
+        }
+      }
+    }
+    // we're far away; execute the normal loop
+    else
+    {
+      // Have we moved far enough?
+      double o_dx = hypot(this->odom_pose.px - this->last_odom_pose.px,
+                          this->odom_pose.py - this->last_odom_pose.py);
+      double o_da = this->angle_diff(this->odom_pose.pa,
+                                     this->last_odom_pose.pa);
+      if((o_dx > this->translate_stuck_dist) ||
+         (fabs(o_da) > this->translate_stuck_angle))
+      {
+        this->last_odom_pose = this->odom_pose;
+        GlobalTime->GetTimeDouble(&this->translate_start_time);
+      }
+      else
+      {
+        // Has it been long enough?
+        double t;
+        GlobalTime->GetTimeDouble(&t);
+        if((t - this->translate_start_time) > this->translate_stuck_time)
+        {
+          PLAYER_WARN("ran out of time trying to get to goal");
+          this->PutPositionCmd(0.0, 0.0);
+          this->stall = true;
+          this->active_goal = false;
+          continue;
+        }
+      }
+
+      this->ComputeRef(this->goal.px, this->goal.py, &vx, &va);
+    }
+
+    vx = this->Threshold(vx, this->vx_min, this->vx_max);
+    if(!vx)
+      va = this->Threshold(va, this->va_min, this->va_max);
+    this->PutPositionCmd(vx, va);
+    latAdd(&this->latency, clockNow() - this->scan_time);
+  }
+}
+
+// computes the signed minimum difference between the two angles.
+double
+NDD::angle_diff(double a, double b)
+{
+  double d1, d2;
+  a = NORMALIZE(a);
+  b = NORMALIZE(b);
+  d1 = a-b;
+  d2 = 2*M_PI - fabs(d1);
+  if(d1 > 0)
+    d2 *= -1.0;
+  if(fabs(d1) < fabs(d2))
+    return(d1);
+  else
+    return(d2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Extra stuff for building a shared object.
+#if 1
+/* need the extern to avoid C++ name-mangling  */
+extern "C" {
+  int player_driver_init(DriverTable* table)
+  {
+    puts("NDD driver initializing");
+    ndd_Register(table);
+    puts("NDD initialization done");
+    return(0);
+  }
+}
+#endif